@@ -0,0 +1,89 @@
+/*
+ * GHashBench.cpp
+ *
+ *  GHash vs. the previous GHash table (OldGHash.hh): adds N transcript-like
+ *  keys, then looks each of them up 3 times (hits) and N other keys 3 times (misses),
+ *  first in insertion order, then shuffled; then adds the N keys again to a table
+ *  keeping only the last N/10 of them (each Add() after the first N/10 is followed
+ *  by the Remove() of the oldest key) and reports the heap used by the GHash
+ *
+ *  usage: GHashBench [N]   (default 1000000)
+ */
+#include "GHash.hh"
+#include "OldGHash.hh"
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <random>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+using namespace std::chrono;
+
+template<class H> void bench(const char* name, std::vector<char*>& keys, std::vector<char*>& miss) {
+	auto t0=steady_clock::now();
+	H h(false);
+	for (size_t i=0;i<keys.size();i++) h.Add(keys[i], (int*)(i+1));
+	auto t1=steady_clock::now();
+	long s=0;
+	for (int r=0;r<3;r++)
+		for (size_t i=0;i<keys.size();i++) s+=(long)h.Find(keys[i]);
+	auto t2=steady_clock::now();
+	for (int r=0;r<3;r++)
+		for (size_t i=0;i<miss.size();i++) s+=(long)h.Find(miss[i]);
+	auto t3=steady_clock::now();
+	printf("%-6s add %.3fs  3x hits %.3fs  3x misses %.3fs  (%ld)\n", name,
+		duration<double>(t1-t0).count(), duration<double>(t2-t1).count(),
+		duration<double>(t3-t2).count(), s);
+}
+
+static double heapMB() {
+#ifdef __GLIBC__
+	return mallinfo2().uordblks/1048576.0;
+#else
+	return 0;
+#endif
+}
+
+template<class H> void churn(const char* name, std::vector<char*>& keys) {
+	size_t w=GMAX(keys.size()/10, (size_t)1);
+	double m0=heapMB();
+	auto t0=steady_clock::now();
+	H h(false);
+	for (size_t i=0;i<keys.size();i++) {
+		h.Add(keys[i], (int*)(i+1));
+		if (i>=w) h.Remove(keys[i-w]);
+	}
+	auto t1=steady_clock::now();
+	printf("%-6s add+remove %.3fs  %d keys left, heap %.1fMB\n", name,
+		duration<double>(t1-t0).count(), h.Count(), heapMB()-m0);
+}
+
+int main(int argc, char* argv[]) {
+	int n=(argc>1) ? atoi(argv[1]) : 1000000;
+	if (n<=0) GError("Usage: GHashBench [N]\n");
+	std::vector<char*> keys, miss;
+	char buf[64];
+	for (int i=0;i<n;i++) {
+		sprintf(buf, "ENST%011d.%d", i*7, i%5+1);
+		keys.push_back(Gstrdup(buf));
+		sprintf(buf, "gene-XM_%09d", i*3+1);
+		miss.push_back(Gstrdup(buf));
+	}
+	printf("%d keys, insertion order:\n", n);
+	bench<OldGHash<int> >("old", keys, miss);
+	bench<GHash<int> >("GHash", keys, miss);
+	std::mt19937 rg(7);
+	std::shuffle(keys.begin(), keys.end(), rg);
+	std::shuffle(miss.begin(), miss.end(), rg);
+	printf("%d keys, shuffled:\n", n);
+	bench<OldGHash<int> >("old", keys, miss);
+	bench<GHash<int> >("GHash", keys, miss);
+	printf("%d keys, churn:\n", n);
+	//(no "old" run here: its Remove() leaves deleted entries behind, and the lookups
+	//slow down until this takes minutes)
+	churn<GHash<int> >("GHash", keys);
+	for (int i=0;i<n;i++) { GFREE(keys[i]); GFREE(miss[i]); }
+	return 0;
+}
@@ -164,6 +164,8 @@ typedef pointer GFLoadProc(FILE* fstorage); //for deserialization
 
 typedef void GFreeProc(pointer item); //usually just delete,
       //but may also support structures with embedded dynamic members
+typedef size_t GReadProc(pointer src, char* buf, size_t len); //like fread(), but from
+      //any data source (e.g. a decompressor); returns less than len only at the end of data
 
 #define GMALLOC(ptr,size)  if (!GMalloc((pointer*)(&ptr),size)) \
                                      GError(ERR_ALLOC)
@@ -217,6 +219,68 @@ bool GCalloc(pointer* ptr, unsigned long size); // Allocate and initialize memor
 bool GRealloc(pointer* ptr,unsigned long size); // Resize memory
 void GFree(pointer* ptr); // Free memory, resets ptr to NULL
 
+//GArena -- bump allocator: memory is taken from large blocks and it is only
+//released all at once, by reset() (keeps the first block for reuse) or clear()
+#define GARENA_BLOCKSIZE 65536
+#define GARENA_PAGEBITS 16 //hookable arena blocks are made of aligned pages of this size
+#define GARENA_PAGESIZE (1<<GARENA_PAGEBITS)
+class GArena {
+   struct GArenaBlock {
+     char* data;
+     size_t size;
+   };
+   GArenaBlock* blocks; //blocks[0] is kept by reset()
+   int nblocks;
+   int capblocks;
+   size_t blocksize;
+   char* cur; //next free byte in the current block
+   char* cend; //end of the current block
+   bool hookable; //block pages are tagged so GFREE/GREALLOC can recognize them
+   void* newBlock(size_t size);
+ public:
+   GArena(size_t bsize=GARENA_BLOCKSIZE, bool hooks=false):blocks(NULL), nblocks(0),
+        capblocks(0), blocksize(bsize), cur(NULL), cend(NULL), hookable(hooks) { }
+   ~GArena() { clear(); }
+   void* alloc(size_t size) { //8-byte aligned, never freed individually
+     size=(size+7) & ~((size_t)7);
+     if ((size_t)(cend-cur)<size) return newBlock(size);
+     void* r=cur;
+     cur+=size;
+     return r;
+   }
+   char* strdup(const char* s, int len=-1) {
+     if (s==NULL) return NULL;
+     if (len<0) len=strlen(s);
+     char* r=(char*)alloc(len+1);
+     memcpy(r, s, len);
+     r[len]=0;
+     return r;
+   }
+   void reset(); //recycle all memory (only the first block is kept)
+   void clear(); //release all memory
+   size_t capacity(); //total size of the allocated blocks
+   //-- allocation hooks: while a (hookable) arena is active in the current thread,
+   // GMALLOC, GCALLOC and GREALLOC take memory from it and GFREE ignores its memory
+   void* hookAlloc(size_t size); //allocation with a size header, as needed by GREALLOC
+   static GArena* activate(GArena* a); //returns the arena previously active
+   static GArena* active();
+   static bool owns(const void* p); //p was allocated by an active or inactive hookable arena
+   static size_t allocSize(const void* p) { return ((size_t*)p)[-2]; } //only for hookAlloc() memory
+};
+
+class GArenaScope { //make an arena (or none, if NULL) active until the end of the scope
+   GArena* prev;
+ public:
+   GArenaScope(GArena* a):prev(GArena::activate(a)) { }
+   ~GArenaScope() { GArena::activate(prev); }
+};
+
+//use in a class declaration to route its new/delete through GMALLOC/GFREE
+// (so its objects are also allocated from the active arena, if any)
+#define GMEM_NEW_DELETE \
+   void* operator new(size_t size) { pointer p=NULL; GMALLOC(p, size); return p; } \
+   void operator delete(void* p) { GFree(&p); }
+
 //int saprintf(char **retp, const char *fmt, ...);
 
 void GError(const char* format,...); // Error routine (aborts program)
@@ -637,6 +701,57 @@ class GLineReader {
      }
 };
 
+// ************** block-buffered line reader for large text files
+//GBlockLineReader -- reads the input in large blocks and returns each line
+//in place, as a pointer into its buffer (valid only until the next getLine() call)
+//Line endings (\n, \r or \r\n) are handled and counted just like fgetline() does
+#define GBLOCK_READSIZE 1048576
+class GBlockLineReader {
+   FILE* file;
+   GReadProc* readProc; //if set, data is read with readProc(readSrc, ..) instead of fread()
+   pointer readSrc;
+   char* buf;
+   int bufcap; //allocated capacity of buf (always keeps 1 byte for the final '\0')
+   int bstart; //start of the unconsumed data in buf
+   int bend; //end of the data in buf
+   bool isEOF; //no more data to read from file
+   int textlen; //length of the last line returned, without the line ending
+   off_t filepos; //file offset right after the last line returned
+   off_t linepos; //file offset of the last line returned
+   int lcount; //line counter (read lines)
+   void fillBuf(); //keep the unconsumed data and read more from file
+ public:
+   GBlockLineReader(FILE* stream=NULL, int blocksize=GBLOCK_READSIZE):file(stream),
+		   readProc(NULL), readSrc(NULL), buf(NULL), bufcap(blocksize+1), bstart(0), bend(0), isEOF(false),
+		   textlen(0), filepos(0), linepos(0), lcount(0) {
+     GMALLOC(buf, bufcap);
+     }
+   ~GBlockLineReader() { GFREE(buf); }
+   void setFile(FILE* stream) { //also resets the reader state
+     file=stream; readProc=NULL; readSrc=NULL;
+     reset();
+     }
+   void reset(off_t fpos=0) { //discard the buffered data, e.g. after the input was repositioned at fpos
+     bstart=0; bend=0; isEOF=false;
+     textlen=0; filepos=fpos; linepos=fpos; lcount=0;
+     }
+   void setSource(pointer src, GReadProc* rproc) { //read from src instead of a FILE
+     setFile(NULL);
+     readSrc=src; readProc=rproc;
+     }
+   char* getLine(int* linelen=NULL); //returns NULL at end of file
+   char* nextLine() { return getLine(); }
+   //returns a run of complete lines (at least minlen bytes unless at end of file) in place,
+   //with their line endings; valid only until the next getLine()/getLines() call
+   //(these lines are not counted by readcount())
+   char* getLines(int& blen, int minlen=GBLOCK_READSIZE);
+   int linelen() { return textlen; } //last line length, excluding newline character(s)
+   int readcount() { return lcount; } //number of lines read
+   off_t getfpos() { return filepos; }
+   off_t getLinePos() { return linepos; } //where the last line returned by getLine() starts
+   bool eof() { return (isEOF && bstart==bend); }
+};
+
 
 /* extended fgets() -  to read one full line from a file and
   update the file position correctly !
@@ -685,4 +800,27 @@ bool parseInt(char* &p, int& i); //advance pointer p after the number
 bool parseUInt(char* &p, uint& i); //advance pointer p after the number
 bool parseHex(char* &p,  uint& i);
 
+//splits a line of slen characters in place at its first maxfields-1 tabs (which are
+//replaced by '\0'), storing the start of each field in fields[];
+//the last field keeps the rest of the line; returns the number of fields found
+//(the tabs are located 16 or 32 bytes at a time with SSE2/AVX2 where available)
+int splitTabs(char* s, int slen, char** fields, int maxfields);
+
+//fast parsing of a whole numeric field (as delimited by splitTabs());
+//anything but plain digits is handed to parseUInt()/parseFloat()
+inline bool parseUIntField(char* p, uint& v) {
+	uint r=0;
+	const char* d=p;
+	while (d-p<9 && (uint)(*d-'0')<10) r=r*10+(uint)(*d++ -'0');
+	if (*d==0 && d!=p) { v=r; return true; }
+	return parseUInt(p, v);
+}
+inline bool parseFloatField(char* p, float& v) {
+	uint r=0;
+	const char* d=p;
+	while (d-p<9 && (uint)(*d-'0')<10) r=r*10+(uint)(*d++ -'0');
+	if (*d==0 && d!=p) { v=(float)r; return true; }
+	return parseFloat(p, v);
+}
+
 #endif /* G_BASE_DEFINED */
@@ -11,26 +11,140 @@
  * indexed by a character string (essentially, maps strings to pointers)
  */
 
-//#define HASH_DBG_PRINT 1
+#define GSTR_HASH(s, len) gstrhash64(s, len)
+
+//64-bit string hash, processing 8 bytes at a time
+inline uint64_t gstrhash64(const char* s, int len) {
+	const uint64_t m=0x9E3779B97F4A7C15ULL;
+	uint64_t h=(uint64_t)len*m;
+	while (len>=8) {
+		uint64_t w;
+		memcpy(&w, s, 8);
+		h=(h^w)*m;
+		h^=h>>29;
+		s+=8;
+		len-=8;
+	}
+	if (len>0) {
+		uint64_t w=0;
+		memcpy(&w, s, len);
+		h=(h^w)*m;
+	}
+	h^=h>>32;
+	h*=0xD6E8FEB86659FD93ULL;
+	h^=h>>32;
+	return h;
+}
 
-#define GSTR_HASH(s) strhash(s)
-//#define GSTR_HASH(s) djb_hash(s)
-//#define GSTR_HASH(s) fnv1a_hash(s)
-//#define GSTR_HASH(s) murmur3(s)
+// Initial table size (MUST be power of 2)
+#define DEF_HASH_SIZE      32
+// Maximum hash table load factor (%)
+#define MAX_LOAD           80
+// Minimum hash table load factor (%)
+#define MIN_LOAD           10
+// Size of the blocks holding the key strings copied by a GHash
+#define GHASH_KEYBLOCK     65536
+
+//storage for the key strings copied by a GHash: keys are packed in large blocks,
+//in 8-byte slots, and never move; the slots of removed keys are kept in per-size
+//free lists and reused by the next keys of the same slot size
+class GHashKeyPool {
+	struct KeyBlock { KeyBlock* next; KeyBlock* prev; };
+	enum { SLOT=8, LONGKEY=(GHASH_KEYBLOCK>>4) }; //keys of LONGKEY or more get their own block
+	KeyBlock* blocks;
+	char* cur;
+	int left;
+	char** freeslots; //free list heads by slot count (allocated on the first release())
+	char* newBlock(int bsize) {
+		KeyBlock* b=NULL;
+		GMALLOC(b, sizeof(KeyBlock)+bsize);
+		b->next=blocks;
+		b->prev=NULL;
+		if (blocks!=NULL) blocks->prev=b;
+		blocks=b;
+		return (char*)(b+1);
+	}
+public:
+	GHashKeyPool():blocks(NULL), cur(NULL), left(0), freeslots(NULL) { }
+	char* add(const char* s, int len) {
+		char* r=NULL;
+		if (len>=LONGKEY) r=newBlock(len+1);
+		else {
+			int ns=len/SLOT+1; //slots needed, with the terminating NUL
+			if (freeslots!=NULL && freeslots[ns]!=NULL) {
+				r=freeslots[ns];
+				freeslots[ns]=*(char**)r;
+			}
+			else {
+				if (ns*SLOT>left) {
+					cur=newBlock(GHASH_KEYBLOCK);
+					left=GHASH_KEYBLOCK;
+				}
+				r=cur;
+				cur+=ns*SLOT;
+				left-=ns*SLOT;
+			}
+		}
+		memcpy(r, s, len);
+		r[len]=0;
+		return r;
+	}
+	void release(char* k, int len) { //k must have been returned by add(k, len)
+		if (len>=LONGKEY) {
+			KeyBlock* b=((KeyBlock*)k)-1;
+			if (b->prev!=NULL) b->prev->next=b->next;
+			else blocks=b->next;
+			if (b->next!=NULL) b->next->prev=b->prev;
+			GFREE(b);
+			return;
+		}
+		if (freeslots==NULL) GCALLOC(freeslots, (LONGKEY/SLOT+1)*sizeof(char*));
+		int ns=len/SLOT+1;
+		*(char**)k=freeslots[ns];
+		freeslots[ns]=k;
+	}
+	void clear() {
+		while (blocks!=NULL) {
+			KeyBlock* b=blocks->next;
+			GFREE(blocks);
+			blocks=b;
+		}
+		cur=NULL;
+		left=0;
+		GFREE(freeslots);
+	}
+	~GHashKeyPool() { clear(); }
+};
 
+/*
+  Notes:
+  - Open addressing with linear probing and Robin Hood insertion: an entry being
+    inserted takes the slot of any entry which is closer to its home slot, so all
+    the probe sequences stay short even at high load, and a lookup can stop as soon
+    as it meets an entry closer to its home slot than the key searched would be.
+  - Removal shifts the following entries back (no tombstones).
+  - We store the 64-bit hash value and the length of each key, so only the lookups
+    with a matching hash and length compare the key strings, and resizing never
+    rehashes keys.
+  - Key copies (Add(), fAdd(), Replace()) are kept in a GHashKeyPool, which reuses
+    the space of the keys dropped by Remove(); shkAdd() keys are not copied, they
+    must outlive the hash table.
+ */
 template <class OBJ> class GHash {
 protected:
 	struct GHashEntry {
-		char*   key;              // Key string
-		bool    keyalloc;         // shared key flag (to free/not the key)
-		int     hash;             // Hash value of key
+		char*   key;              // Key string (NULL for an empty slot)
+		uint64_t hash;            // Hash value of key
 		pointer data;             // Data
+		int     klen;             // Key length
+		bool    shared;           // Key added by shkAdd(), not in the key pool
 	};
 	GHashEntry* hash;          // Hash
 	int         fCapacity;     // table size
 	int         fCount;        // number of valid entries
 	int  fCurrentEntry;
 	char* lastkeyptr; //pointer to last key string added
+	GHashKeyPool keypool;
 	//---------- Raw data retrieval (including empty entries)
 	// Return key at position pos.
 	const char* Key(uint pos) const { return hash[pos].key; }
@@ -47,6 +161,14 @@ protected:
 	//Return position of previous filled slot in hash table
 	//or a -1 if no filled slot was found
 	int Prev(int pos) const;
+	//distance of the entry at pos from its home slot
+	int probeDist(int pos, uint64_t h) const { return (pos-(int)(h & (fCapacity-1))) & (fCapacity-1); }
+	//position of the entry with the given key, or -1
+	int findPos(const char* ky, int klen, uint64_t h) const;
+	//adds a new entry (the key must not be in the table already)
+	void insertNew(char* ky, int klen, uint64_t h, pointer pdata, bool shared=false);
+	void removeAt(int pos);
+	void initTable();
 
 private:
 	GHash(const GHash&);
@@ -63,11 +185,14 @@ public:
 	void setFreeItem(GFreeProc *freeProc) { fFreeProc=freeProc; }
 	void setFreeItem(bool doFree) { fFreeProc=(doFree)? &DefaultFreeProc : NULL; }
 	int Capacity() const { return fCapacity; } // table's size, including the empty slots.
-	void Resize(int m);  // Resize the table to the given size.
+	void Resize(int m);  // Resize the table for m entries.
+	//make room for at least n entries, so adding them does not grow the table
+	void reserve(int n) { if ((int64)100*n>=(int64)MAX_LOAD*fCapacity) Resize(n); }
 	int Count() const { return fCount; }// the total number of entries in the table.
 
 	// Insert a new entry into the table given key.
-	// If there is already an entry with that key, leave it unchanged
+	// If there is already an entry with that key, its data is replaced
+	// (and the old data is returned)
 	OBJ* Add(const char* ky, OBJ* ptr=NULL);
 
 	//same with Add, but frees the old element if it's a replacement
@@ -84,7 +209,10 @@ public:
 	OBJ* Remove(const char* ky);
 	// Find data OBJ* given key.
 	OBJ* Find(const char* ky, char** keyptr=NULL);
+	// Find data OBJ* given the first klen characters of ky as key (ky need not be NUL terminated)
+	OBJ* FindLen(const char* ky, int klen, char** keyptr=NULL);
 	bool hasKey(const char* ky);
+	bool hasKeyLen(const char* ky, int klen);
 	char* getLastKey() { return lastkeyptr; }
 	OBJ* operator[](const char* ky) { return Find(ky); }
 	void startIterate(); //iterator-like initialization
@@ -95,7 +223,7 @@ public:
 	//nextkey is SET to the corresponding key
 	GHashEntry* NextEntry() { //returns a pointer to a GHashEntry
 		int pos=fCurrentEntry;
-		while (pos<fCapacity && hash[pos].hash<0) pos++;
+		while (pos<fCapacity && hash[pos].key==NULL) pos++;
 		if (pos==fCapacity) {
 			fCurrentEntry=fCapacity;
 			return NULL;
@@ -114,309 +242,196 @@ public:
 //
 //======================== method definitions ========================
 //
-/*
-  Notes:
-  - Since the algorithm doubles the table size when exceeding MAX_LOAD,
-    it would be prudent to keep MIN_LOAD less than 1/2 MAX_LOAD;
-    otherwise, the algorithm might flip between halving and doubling!
-  - We store the key hash value so that 99.999% of the time we can compare hash numbers;
-    only when hash numbers match we need to compare keys.
-  - Thus with a good hash function the fCount of calls to strcmp() should be
-    roughly the same as the fCount of successful lookups.
- */
-
-// Initial table size (MUST be power of 2)
-#define DEF_HASH_SIZE      32
-// Maximum hash table load factor (%)
-#define MAX_LOAD           80
-// Minimum hash table load factor (%)
-#define MIN_LOAD           10
-
-// Probe Position [0..n-1]
-#define HASH1(x,n) (((unsigned int)(x)*13)%(n))
-// Probe Distance [1..n-1]
-#define HASH2(x,n) (1|(((unsigned int)(x)*17)%((n)-1)))
 
 #define FREEDATA (fFreeProc!=NULL)
 
 /*******************************************************************************/
-// Construct empty hash
-template <class OBJ> GHash<OBJ>::GHash(GFreeProc* freeProc) {
+template <class OBJ> void GHash<OBJ>::initTable() {
 	GMALLOC(hash, sizeof(GHashEntry)*DEF_HASH_SIZE);
-	fCurrentEntry=-1;
-	fFreeProc=freeProc;
-	lastkeyptr=NULL;
 	for (uint i=0; i<DEF_HASH_SIZE; i++)
-		hash[i].hash=-1; //this will be an indicator for 'empty' entries
+		hash[i].key=NULL; //this will be an indicator for 'empty' entries
 	fCapacity=DEF_HASH_SIZE;
 	fCount=0;
 }
 
-template <class OBJ> GHash<OBJ>::GHash(bool doFree) {
-	GMALLOC(hash, sizeof(GHashEntry)*DEF_HASH_SIZE);
+// Construct empty hash
+template <class OBJ> GHash<OBJ>::GHash(GFreeProc* freeProc):keypool() {
+	fCurrentEntry=-1;
+	fFreeProc=freeProc;
+	lastkeyptr=NULL;
+	initTable();
+}
+
+template <class OBJ> GHash<OBJ>::GHash(bool doFree):keypool() {
 	fCurrentEntry=-1;
 	lastkeyptr=NULL;
 	fFreeProc = (doFree)?&DefaultFreeProc : NULL;
-	for (uint i=0; i<DEF_HASH_SIZE; i++)
-		hash[i].hash=-1; //this will be an indicator for 'empty' entries
-	fCapacity=DEF_HASH_SIZE;
-	fCount=0;
+	initTable();
 }
 
 
 // Resize table
 template <class OBJ> void GHash<OBJ>::Resize(int m) {
-	int i,n,p,x,h;
-	GHashEntry *k;
-	GASSERT(fCount<=fCapacity);
-	if(m<DEF_HASH_SIZE) m=DEF_HASH_SIZE;
-	n=fCapacity;
-	while((n>>2)>m) n>>=1;            // Shrink until n/4 <= m
-	while((n>>1)<m) n<<=1;            // Grow until m <= n/2
-	GASSERT(m<=(n>>1));
-	GASSERT(DEF_HASH_SIZE<=n);
-	if(n!=fCapacity){
-		GASSERT(m<=n);
-		GMALLOC(k, sizeof(GHashEntry)*n);
-		for(i=0; i<n; i++) k[i].hash=-1;
-		for(i=0; i<fCapacity; i++){
-			h=hash[i].hash;
-			if(h>=0){
-				p=HASH1(h,n);
-				GASSERT(0<=p && p<n);
-				x=HASH2(h,n);
-				GASSERT(1<=x && x<n);
-				while(k[p].hash!=-1) p=(p+x)%n;
-				GASSERT(k[p].hash<0);
-				k[p]=hash[i];
-			}
-		}
-		GFREE(hash);
-		hash=k;
-		fCapacity=n;
+	GASSERT(fCount<=m);
+	int n=DEF_HASH_SIZE;
+	while ((int64)100*m>=(int64)MAX_LOAD*n) n<<=1; // smallest table for m entries
+	if (n==fCapacity) return;
+	GHashEntry* oldhash=hash;
+	int oldcap=fCapacity;
+	GMALLOC(hash, sizeof(GHashEntry)*n);
+	for (int i=0; i<n; i++) hash[i].key=NULL;
+	fCapacity=n;
+	fCount=0;
+	for (int i=0; i<oldcap; i++) {
+		GHashEntry& e=oldhash[i];
+		if (e.key!=NULL) insertNew(e.key, e.klen, e.hash, e.data, e.shared);
 	}
+	GFREE(oldhash);
 }
 
-// add a new entry, or update it if it already exists
+template <class OBJ> int GHash<OBJ>::findPos(const char* ky, int klen, uint64_t h) const {
+	int mask=fCapacity-1;
+	int p=h & mask;
+	for (int d=0;;d++) {
+		const GHashEntry& e=hash[p];
+		if (e.key==NULL || probeDist(p, e.hash)<d) return -1;
+		if (e.hash==h && e.klen==klen && memcmp(e.key, ky, klen)==0) return p;
+		p=(p+1) & mask;
+	}
+}
 
+template <class OBJ> void GHash<OBJ>::insertNew(char* ky, int klen, uint64_t h, pointer pdata, bool shared) {
+	GHashEntry ne;
+	ne.key=ky;
+	ne.hash=h;
+	ne.klen=klen;
+	ne.shared=shared;
+	ne.data=pdata;
+	int mask=fCapacity-1;
+	int p=h & mask;
+	for (int d=0;;d++) {
+		GHashEntry& e=hash[p];
+		if (e.key==NULL) {
+			e=ne;
+			break;
+		}
+		int ed=probeDist(p, e.hash);
+		if (ed<d) { //the entry here is closer to its home slot, it moves on instead
+			GHashEntry t=e;
+			e=ne;
+			ne=t;
+			d=ed;
+		}
+		p=(p+1) & mask;
+	}
+	fCount++;
+}
 
+// add a new entry, or update it if it already exists
 template <class OBJ> OBJ* GHash<OBJ>::Add(const char* ky, OBJ* pdata) {
-	int p,i,x,h,n;
 	if(!ky) GError("GHash::insert: NULL key argument.\n");
-	GASSERT(fCount<fCapacity);
-	h=GSTR_HASH(ky);
-	GASSERT(0<=h);
-	p=HASH1(h,fCapacity);
-	GASSERT(0<=p && p<fCapacity);
-	x=HASH2(h,fCapacity);
-	GASSERT(1<=x && x<fCapacity);
-	i=-1;
-	n=fCapacity;
-#ifdef HASH_DBG_PRINT
-	int iterations=0;
-	int init_p=p;
-	int init_x=x;
-#endif
-	while(n && hash[p].hash!=-1) {
-		if ((i==-1)&&(hash[p].hash==-2)) i=p;
-		if (hash[p].hash==h && strcmp(hash[p].key,ky)==0) {
-			//replace hash data for this key!
-			lastkeyptr=hash[p].key;
-			OBJ* r = (OBJ*) hash[p].data;
-			hash[p].data = (void*) pdata;
-#ifdef HASH_DBG_PRINT
-			GMessage("Add.R\t%s\t%d,%d,%d\t%d\t%d\t%d\n",
-					ky, h,init_p,init_x, iterations,  fCount, fCapacity);
-#endif
-			return r;
-		}
-		p=(p+x)%fCapacity;
-		n--;
+	int klen=strlen(ky);
+	uint64_t h=GSTR_HASH(ky, klen);
+	int p=findPos(ky, klen, h);
+	if (p>=0) {
+		//replace hash data for this key!
+		lastkeyptr=hash[p].key;
+		OBJ* r = (OBJ*) hash[p].data;
+		hash[p].data = (void*) pdata;
+		return r;
 	}
-	if(i==-1) i=p;
-#ifdef HASH_DBG_PRINT
-	GMessage("Add.N\t%s\t%d,%d,%d\t%d\t%d\t%d\n",
-			ky, h,init_p,init_x, iterations,  fCount, fCapacity);
-#endif
 	GTRACE(("GHash::insert: key=\"%s\"\n",ky));
-	//GMessage("GHash::insert: key=\"%s\"\n",ky);
-	GASSERT(0<=i && i<fCapacity);
-	GASSERT(hash[i].hash<0);
-	hash[i].hash=h;
-	hash[i].key=Gstrdup(ky);
-	hash[i].keyalloc=true;
-	lastkeyptr=hash[i].key;
-	hash[i].data= (void*) pdata;
-	fCount++;
-	if((100*fCount)>=(MAX_LOAD*fCapacity)) Resize(fCount);
-	GASSERT(fCount<fCapacity);
+	if ((int64)100*(fCount+1)>=(int64)MAX_LOAD*fCapacity) Resize(fCount+1);
+	lastkeyptr=keypool.add(ky, klen);
+	insertNew(lastkeyptr, klen, h, (void*) pdata);
 	return pdata;
 }
 
 template <class OBJ> OBJ* GHash<OBJ>::fAdd(const char* ky, OBJ* pdata) {
-	int p,i,x,h,n;
 	if(!ky) GError("GHash::insert: NULL key argument.\n");
-	GASSERT(fCount<fCapacity);
-	h=GSTR_HASH(ky);
-	GASSERT(0<=h);
-	p=HASH1(h,fCapacity);
-	GASSERT(0<=p && p<fCapacity);
-	x=HASH2(h,fCapacity);
-	GASSERT(1<=x && x<fCapacity);
-	i=-1;
-	n=fCapacity;
-#ifdef HASH_DBG_PRINT
-	int iterations=0;
-	int init_p=p;
-	int init_x=x;
-#endif
-	while(n && hash[p].hash!=-1) {
-		if ((i==-1)&&(hash[p].hash==-2)) i=p;
-		if (hash[p].hash==h && strcmp(hash[p].key,ky)==0) {
-			//replace hash data for this key!
-			lastkeyptr=hash[p].key;
-			if (FREEDATA) (*fFreeProc)(hash[p].data);
-			hash[p].data = (void*) pdata;
-#ifdef HASH_DBG_PRINT
-			GMessage("Add.R\t%s\t%d,%d,%d\t%d\t%d\t%d\n",
-					ky, h,init_p,init_x, iterations,  fCount, fCapacity);
-#endif
-			return pdata;
-		}
-		p=(p+x)%fCapacity;
-#ifdef HASH_DBG_PRINT
-		++iterations;
-#endif
-		n--;
+	int klen=strlen(ky);
+	uint64_t h=GSTR_HASH(ky, klen);
+	int p=findPos(ky, klen, h);
+	if (p>=0) {
+		//replace hash data for this key!
+		lastkeyptr=hash[p].key;
+		if (FREEDATA) (*fFreeProc)(hash[p].data);
+		hash[p].data = (void*) pdata;
+		return pdata;
 	}
-	if(i==-1) i=p;
-#ifdef HASH_DBG_PRINT
-	GMessage("Add.N\t%s\t%d,%d,%d\t%d\t%d\t%d\n",
-			ky, h,init_p,init_x, iterations,  fCount, fCapacity);
-#endif
 	GTRACE(("GHash::insert: key=\"%s\"\n",ky));
-	//GMessage("GHash::insert: key=\"%s\"\n",ky);
-	GASSERT(0<=i && i<fCapacity);
-	GASSERT(hash[i].hash<0);
-	hash[i].hash=h;
-	hash[i].key=Gstrdup(ky);
-	hash[i].keyalloc=true;
-	lastkeyptr=hash[i].key;
-	hash[i].data= (void*) pdata;
-	fCount++;
-	if((100*fCount)>=(MAX_LOAD*fCapacity)) Resize(fCount);
-	GASSERT(fCount<fCapacity);
+	if ((int64)100*(fCount+1)>=(int64)MAX_LOAD*fCapacity) Resize(fCount+1);
+	lastkeyptr=keypool.add(ky, klen);
+	insertNew(lastkeyptr, klen, h, (void*) pdata);
 	return pdata;
 }
 
 template <class OBJ> OBJ* GHash<OBJ>::shkAdd(const char* ky, OBJ* pdata) {
-	int p,i,x,h,n;
 	if(!ky) GError("GHash::insert: NULL key argument.\n");
-	GASSERT(fCount<fCapacity);
-	h=GSTR_HASH(ky);
-	GASSERT(0<=h);
-	p=HASH1(h,fCapacity);
-	GASSERT(0<=p && p<fCapacity);
-	x=HASH2(h,fCapacity);
-	GASSERT(1<=x && x<fCapacity);
-	i=-1;
-	n=fCapacity;
-	while(n && hash[p].hash!=-1){
-		if((i==-1)&&(hash[p].hash==-2)) i=p;
-		if(hash[p].hash==h && strcmp(hash[p].key,ky)==0){
-			//replace hash data for this key!
-			lastkeyptr=hash[p].key;
-			hash[p].data = (void*) pdata;
-			return (OBJ*)hash[p].data;
-		}
-		p=(p+x)%fCapacity;
-		n--;
+	int klen=strlen(ky);
+	uint64_t h=GSTR_HASH(ky, klen);
+	int p=findPos(ky, klen, h);
+	if (p>=0) {
+		//replace hash data for this key!
+		lastkeyptr=hash[p].key;
+		hash[p].data = (void*) pdata;
+		return (OBJ*)hash[p].data;
 	}
-	if(i==-1) i=p;
 	GTRACE(("GHash::insert: key=\"%s\"\n",ky));
-	//GMessage("GHash::insert: key=\"%s\"\n",ky);
-	GASSERT(0<=i && i<fCapacity);
-	GASSERT(hash[i].hash<0);
-	hash[i].hash=h;
-	hash[i].key=(char *)ky;
-	lastkeyptr=hash[i].key;
-	hash[i].keyalloc=false;
-	hash[i].data= (void*) pdata;
-	fCount++;
-	if((100*fCount)>=(MAX_LOAD*fCapacity)) Resize(fCount);
-	GASSERT(fCount<fCapacity);
+	if ((int64)100*(fCount+1)>=(int64)MAX_LOAD*fCapacity) Resize(fCount+1);
+	lastkeyptr=(char*)ky;
+	insertNew(lastkeyptr, klen, h, (void*) pdata, true);
 	return pdata;
 }
 
 // Add or replace entry
 template <class OBJ>  OBJ* GHash<OBJ>::Replace(const char* ky, OBJ* pdata){
-	int p,i,x,h,n;
 	if(!ky){ GError("GHash::replace: NULL key argument.\n"); }
-	GASSERT(fCount<fCapacity);
-	h=GSTR_HASH(ky);
-	GASSERT(0<=h);
-	p=HASH1(h,fCapacity);
-	GASSERT(0<=p && p<fCapacity);
-	x=HASH2(h,fCapacity);
-	GASSERT(1<=x && x<fCapacity);
-	i=-1;
-	n=fCapacity;
-	while(n && hash[p].hash!=-1){
-		if((i==-1)&&(hash[p].hash==-2)) i=p;
-		if(hash[p].hash==h && strcmp(hash[p].key,ky)==0){
-			GTRACE(("GHash::replace: %08x: replacing: \"%s\"\n",this,ky));
-			if (FREEDATA) (*fFreeProc)(hash[p].data);
-			hash[p].data=pdata;
-			return hash[p].data;
-		}
-		p=(p+x)%fCapacity;
-		n--;
+	int klen=strlen(ky);
+	uint64_t h=GSTR_HASH(ky, klen);
+	int p=findPos(ky, klen, h);
+	if (p>=0) {
+		GTRACE(("GHash::replace: %08x: replacing: \"%s\"\n",this,ky));
+		if (FREEDATA) (*fFreeProc)(hash[p].data);
+		hash[p].data=pdata;
+		return (OBJ*)hash[p].data;
 	}
-	if(i==-1) i=p;
 	GTRACE(("GHash::replace: %08x: inserting: \"%s\"\n",this,ky));
-	GASSERT(0<=i && i<fCapacity);
-	GASSERT(hash[i].hash<0);
-	hash[i].hash=h;
-	hash[i].key=Gstrdup(ky);
-	hash[i].data=pdata;
-	fCount++;
-	if((100*fCount)>=(MAX_LOAD*fCapacity)) Resize(fCount);
-	GASSERT(fCount<fCapacity);
+	if ((int64)100*(fCount+1)>=(int64)MAX_LOAD*fCapacity) Resize(fCount+1);
+	insertNew(keypool.add(ky, klen), klen, h, (void*) pdata);
 	return pdata;
 }
 
+//remove the entry at pos, shifting back the entries following it
+template <class OBJ> void GHash<OBJ>::removeAt(int pos) {
+	int mask=fCapacity-1;
+	int nx=(pos+1) & mask;
+	while (hash[nx].key!=NULL && probeDist(nx, hash[nx].hash)>0) {
+		hash[pos]=hash[nx];
+		pos=nx;
+		nx=(nx+1) & mask;
+	}
+	hash[pos].key=NULL;
+	hash[pos].data=NULL;
+	fCount--;
+}
 
 // Remove entry
 template <class OBJ> OBJ* GHash<OBJ>::Remove(const char* ky){
-	int p,x,h,n;
 	if(!ky){ GError("GHash::remove: NULL key argument.\n"); }
 	OBJ* removed=NULL;
-	if(0<fCount){
-		h=GSTR_HASH(ky);
-		GASSERT(0<=h);
-		p=HASH1(h,fCapacity);
-		GASSERT(0<=p && p<fCapacity);
-		x=HASH2(h,fCapacity);
-		GASSERT(1<=x && x<fCapacity);
-		GASSERT(fCount<fCapacity);
-		n=fCapacity;
-		while(n && hash[p].hash!=-1){
-			if(hash[p].hash==h && strcmp(hash[p].key,ky)==0){
-				GTRACE(("GHash::remove: %08x removing: \"%s\"\n",this,ky));
-				hash[p].hash=-2;
-				if (hash[p].keyalloc) GFREE((hash[p].key));
-				if (FREEDATA) (*fFreeProc)(hash[p].data);
-				else removed=(OBJ*)hash[p].data;
-				hash[p].key=NULL;
-				hash[p].data=NULL;
-				fCount--;
-				if((100*fCount)<=(MIN_LOAD*fCapacity)) Resize(fCount);
-				GASSERT(fCount<fCapacity);
-				return removed;
-			}
-			p=(p+x)%fCapacity;
-			n--;
-		}
+	if (fCount==0) return removed;
+	int klen=strlen(ky);
+	int p=findPos(ky, klen, GSTR_HASH(ky, klen));
+	if (p>=0) {
+		GTRACE(("GHash::remove: %08x removing: \"%s\"\n",this,ky));
+		if (FREEDATA) (*fFreeProc)(hash[p].data);
+		else removed=(OBJ*)hash[p].data;
+		char* k=hash[p].key;
+		if (k==lastkeyptr) lastkeyptr=NULL;
+		if (!hash[p].shared) keypool.release(k, hash[p].klen);
+		removeAt(p);
+		if ((100*fCount)<=(MIN_LOAD*fCapacity)) Resize(fCount);
 	}
 	return removed;
 }
@@ -424,66 +439,31 @@ template <class OBJ> OBJ* GHash<OBJ>::Remove(const char* ky){
 
 // Find entry
 template <class OBJ> bool GHash<OBJ>::hasKey(const char* ky) {
-	int p,x,h,n;
 	if(!ky){ GError("GHash::find: NULL key argument.\n"); }
-	if(0<fCount){
-		h=GSTR_HASH(ky);
-		GASSERT(0<=h);
-		p=HASH1(h,fCapacity);
-		GASSERT(0<=p && p<fCapacity);
-		x=HASH2(h,fCapacity);
-		GASSERT(1<=x && x<fCapacity);
-		GASSERT(fCount<fCapacity);
-		n=fCapacity;
-		while(n && hash[p].hash!=-1){
-			if(hash[p].hash==h && strcmp(hash[p].key,ky)==0){
-				return true;
-			}
-			p=(p+x)%fCapacity;
-			n--;
-		}
-	}
-	return false;
+	if (fCount==0) return false;
+	int klen=strlen(ky);
+	return (findPos(ky, klen, GSTR_HASH(ky, klen))>=0);
 }
 
+template <class OBJ> bool GHash<OBJ>::hasKeyLen(const char* ky, int klen) {
+	if(!ky){ GError("GHash::find: NULL key argument.\n"); }
+	if (fCount==0) return false;
+	return (findPos(ky, klen, GSTR_HASH(ky, klen))>=0);
+}
+
+template <class OBJ> OBJ* GHash<OBJ>::FindLen(const char* ky, int klen, char** keyptr){
+	if(!ky){ GError("GHash::find: NULL key argument.\n"); }
+	if (fCount==0) return NULL;
+	int p=findPos(ky, klen, GSTR_HASH(ky, klen));
+	if (p<0) return NULL;
+	if (keyptr!=NULL) *keyptr = hash[p].key;
+	return (OBJ*)hash[p].data;
+}
 
 template <class OBJ> OBJ* GHash<OBJ>::Find(const char* ky, char** keyptr){
-	int p,x,h,n;
 	if(!ky){ GError("GHash::find: NULL key argument.\n"); }
 	if (fCount==0) return NULL;
-	h=GSTR_HASH(ky);
-	GASSERT(0<=h);
-	p=HASH1(h,fCapacity);
-	GASSERT(0<=p && p<fCapacity);
-	x=HASH2(h,fCapacity);
-	GASSERT(1<=x && x<fCapacity);
-	GASSERT(fCount<fCapacity);
-	n=fCapacity;
-#ifdef HASH_DBG_PRINT
-	int iterations=0;
-	int init_p=p;
-	int init_x=x;
-#endif
-	while(n && hash[p].hash!=-1){
-		if(hash[p].hash==h && strcmp(hash[p].key,ky)==0){
-			if (keyptr!=NULL) *keyptr = hash[p].key;
-#ifdef HASH_DBG_PRINT
-			GMessage("Found \t%s\t%d,%d,%d\t%d\t%d\t%d\n",
-					ky, h,init_p,init_x, iterations,  fCount, fCapacity);
-#endif
-			return (OBJ*)hash[p].data;
-		}
-		p=(p+x)%fCapacity;
-		n--;
-#ifdef HASH_DBG_PRINT
-		++iterations;
-#endif
-	}
-#ifdef HASH_DBG_PRINT
-	GMessage("Nfound\t%s\t%d,%d,%d\t%d\t%d\t%d\n",
-			ky, h,init_p,init_x, iterations,  fCount, fCapacity);
-#endif
-	return NULL;
+	return FindLen(ky, strlen(ky), keyptr);
 }
 
 template <class OBJ> void GHash<OBJ>::startIterate() {// initialize a key iterator; call
@@ -491,62 +471,37 @@ template <class OBJ> void GHash<OBJ>::startIterate() {// initialize a key iterat
 }
 
 template <class OBJ> char* GHash<OBJ>::NextKey() {
-	int pos=fCurrentEntry;
-	while (pos<fCapacity && hash[pos].hash<0) pos++;
-	if (pos==fCapacity) {
-		fCurrentEntry=fCapacity;
-		return NULL;
-	}
-	else {
-		fCurrentEntry=pos+1;
-		return hash[pos].key;
-	}
+	GHashEntry* e=NextEntry();
+	return (e==NULL) ? NULL : e->key;
 }
 
 template <class OBJ> OBJ* GHash<OBJ>::NextData() {
-	int pos=fCurrentEntry;
-	while (pos<fCapacity && hash[pos].hash<0) pos++;
-	if (pos==fCapacity) {
-		fCurrentEntry=fCapacity;
-		return NULL;
-	}
-	else {
-		fCurrentEntry=pos+1;
-		return (OBJ*)hash[pos].data;
-	}
-
+	GHashEntry* e=NextEntry();
+	return (e==NULL) ? NULL : (OBJ*)e->data;
 }
 
 template <class OBJ> OBJ* GHash<OBJ>::NextData(char* &nextkey) {
-	int pos=fCurrentEntry;
-	while (pos<fCapacity && hash[pos].hash<0) pos++;
-	if (pos==fCapacity) {
-		fCurrentEntry=fCapacity;
+	GHashEntry* e=NextEntry();
+	if (e==NULL) {
 		nextkey=NULL;
 		return NULL;
 	}
-	else {
-		fCurrentEntry=pos+1;
-		nextkey=hash[pos].key;
-		return (OBJ*)hash[pos].data;
-	}
-
+	nextkey=e->key;
+	return (OBJ*)e->data;
 }
 
 
 // Get first non-empty entry
 template <class OBJ> int GHash<OBJ>::First() const {
 	int pos=0;
-	while(pos<fCapacity){ if(0<=hash[pos].hash) break; pos++; }
-	GASSERT(fCapacity<=pos || 0<=hash[pos].hash);
+	while(pos<fCapacity){ if(hash[pos].key!=NULL) break; pos++; }
 	return pos;
 }
 
 // Get last non-empty entry
 template <class OBJ> int GHash<OBJ>::Last() const {
 	int pos=fCapacity-1;
-	while(0<=pos){ if(0<=hash[pos].hash) break; pos--; }
-	GASSERT(pos<0 || 0<=hash[pos].hash);
+	while(0<=pos){ if(hash[pos].key!=NULL) break; pos--; }
 	return pos;
 }
 
@@ -554,8 +509,7 @@ template <class OBJ> int GHash<OBJ>::Last() const {
 // Find next valid entry
 template <class OBJ> int GHash<OBJ>::Next(int pos) const {
 	GASSERT(0<=pos && pos<fCapacity);
-	while(++pos <= fCapacity-1){ if(0<=hash[pos].hash) break; }
-	GASSERT(fCapacity<=pos || 0<=hash[pos].hash);
+	while(++pos <= fCapacity-1){ if(hash[pos].key!=NULL) break; }
 	return pos;
 }
 
@@ -563,38 +517,28 @@ template <class OBJ> int GHash<OBJ>::Next(int pos) const {
 // Find previous valid entry
 template <class OBJ> int GHash<OBJ>::Prev(int pos) const {
 	GASSERT(0<=pos && pos<fCapacity);
-	while(--pos >= 0){ if(0<=hash[pos].hash) break; }
-	GASSERT(pos<0 || 0<=hash[pos].hash);
+	while(--pos >= 0){ if(hash[pos].key!=NULL) break; }
 	return pos;
 }
 
 
 // Remove all
 template <class OBJ> void GHash<OBJ>::Clear(){
-	int i;
-	for(i=0; i<fCapacity; i++){
-		if(hash[i].hash>=0){
-			if (hash[i].keyalloc) GFREE((hash[i].key));
-			if (FREEDATA)
-				(*fFreeProc)(hash[i].data);
-		}
+	if (FREEDATA) {
+		for (int i=0; i<fCapacity; i++)
+			if (hash[i].key!=NULL) (*fFreeProc)(hash[i].data);
 	}
 	GFREE(hash);
-	GMALLOC(hash, sizeof(GHashEntry)*DEF_HASH_SIZE);
-	//reinitialize it
-	for (i=0; i<DEF_HASH_SIZE; i++)
-		hash[i].hash=-1; //this will be an indicator for 'empty' entries
-	fCapacity=DEF_HASH_SIZE;
-	fCount=0;
+	keypool.clear();
+	lastkeyptr=NULL;
+	initTable();
 }
 
 // Destroy table
 template <class OBJ> GHash<OBJ>::~GHash(){
-	for(int i=0; i<fCapacity; i++){
-		if(hash[i].hash>=0){
-			if (hash[i].keyalloc) GFREE((hash[i].key));
-			if (FREEDATA) (*fFreeProc)(hash[i].data);
-		}
+	if (FREEDATA) {
+		for (int i=0; i<fCapacity; i++)
+			if (hash[i].key!=NULL) (*fFreeProc)(hash[i].data);
 	}
 	GFREE(hash);
 }
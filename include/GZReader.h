@@ -0,0 +1,91 @@
+/*
+ * GZReader.h
+ *
+ *  transparent reading of gzip and BGZF compressed input
+ */
+
+#ifndef GZREADER_H_
+#define GZREADER_H_
+
+#include "GBase.h"
+#include <thread>
+
+struct z_stream_s;
+
+//a batch of BGZF blocks, inflated together
+struct GZBatch {
+	char* cdata; //compressed blocks, as read from the file
+	size_t ccap;
+	size_t clen;
+	GDynArray<uint32_t> boffs; //start of each block in cdata (+ the end of the last one)
+	GDynArray<size_t> uoffs; //start of each inflated block in udata (+ total size)
+	char* udata; //inflated data
+	size_t ucap;
+	size_t ulen;
+	size_t upos; //how much of udata was consumed
+	int64 cstart; //file offset of the first block
+	bool eof; //no more blocks after this batch
+	GZBatch():cdata(NULL), ccap(0), clen(0), boffs(), uoffs(),
+			udata(NULL), ucap(0), ulen(0), upos(0), cstart(0), eof(false) { }
+	~GZBatch() { GFREE(cdata); GFREE(udata); }
+};
+
+struct GZBlockPos { //where a BGZF block starts
+	int64 upos; //in the decompressed data
+	int64 coffset; //in the file
+};
+
+//GZReader -- decompresses a gzip or BGZF file;
+//plain gzip (also multi-member) is inflated as a single stream, while BGZF blocks
+//are inflated by multiple threads in batches, with the next batch prepared in the
+//background while the current one is consumed
+class GZReader {
+	FILE* file;
+	bool bgzf;
+	int nthreads;
+	//plain gzip
+	struct z_stream_s* zs;
+	char* inbuf;
+	bool zdone;
+	//BGZF
+	GZBatch batches[2];
+	int bcur; //batch being consumed
+	bool started;
+	std::thread prefetch; //prepares batches[1-bcur]
+	int maxblocks; //number of BGZF blocks per batch
+	int64 cpos; //file offset of the next block to read
+	int64 utotal; //decompressed data size of the batches consumed so far
+	GDynArray<GZBlockPos> blockmap; //blocks consumed since the last seek(), for voffset()
+	int bmcur; //last blockmap entry found by voffset()
+	int skipbytes; //to be skipped in the first block after a seek()
+	size_t readGz(char* buf, size_t len);
+	size_t readBgzf(char* buf, size_t len);
+	bool readBlocks(GZBatch& b); //read the next batch of compressed blocks
+	void inflateBatch(GZBatch& b); //inflate (in parallel) the blocks read in b
+	void fillBatch(GZBatch& b) { if (readBlocks(b)) inflateBatch(b); }
+	void useBatch(int bidx); //make batches[bidx] the current batch
+ public:
+	//checks the first bytes of a seekable stream, which is then rewound:
+	//returns 0 if the data is not compressed, 1 for gzip, 2 for BGZF
+	static int detect(FILE* f);
+	GZReader(FILE* f, bool isBGZF, int threads=0);
+	~GZReader();
+	//number of threads used to inflate BGZF blocks, can only be changed before the first read()
+	//(0 = use the number of available cores, up to 8)
+	void setThreads(int threads);
+	bool isBGZF() { return bgzf; }
+	//fills buf with up to len bytes of decompressed data;
+	//returns less than len only at the end of the data
+	size_t read(char* buf, size_t len);
+	//BGZF virtual offsets (block file offset<<16 | offset in the decompressed block):
+	//seek() positions the reader at a virtual offset; voffset() converts a position in the
+	//decompressed data since then (counted from the start of the block seek() went to);
+	//plain gzip input can only be rewound, with seek(0)
+	bool seek(int64 voff);
+	int64 voffset(int64 upos);
+	static size_t readProc(pointer src, char* buf, size_t len) { //GReadProc
+		return ((GZReader*)src)->read(buf, len);
+	}
+};
+
+#endif /* GZREADER_H_ */
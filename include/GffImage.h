@@ -0,0 +1,133 @@
+/*
+ * GffImage.h
+ *
+ *  read-only columnar annotation image, used in place through mmap()
+ */
+
+#ifndef GFFIMAGE_H_
+#define GFFIMAGE_H_
+
+#include "GBase.h"
+#include "GVec.hh"
+#include "GHash.hh"
+
+#define GFFIMG_MAGIC "GFFIMG1"
+#define GFFIMG_NONE 0xFFFFFFFFu //no string/parent for a record
+
+class GfList;
+class GffImage;
+
+//image file layout: the header, then 8-byte aligned sections at the given offsets,
+//in this order; strings are stored as offsets into the string heap (NUL terminated)
+struct GffImgHeader {
+	char magic[8];
+	uint32_t nrecs; //records, sorted by genomic sequence name, then start, end
+	uint32_t nseqs;
+	uint32_t nattrs; //attribute columns
+	uint32_t reserved;
+	uint64_t seqtab; //GffImgSeq[nseqs]
+	uint64_t reccols; //record columns, GFFIMG_NUMCOLS x uint32_t[nrecs]
+	uint64_t strands; //char[nrecs]
+	uint64_t exondata; //exon coordinates, delta encoded as pairs of varints
+	uint64_t attrnames; //uint32_t[nattrs]
+	uint64_t attrcols; //uint32_t[nattrs][nrecs] value strings
+	uint64_t strheap;
+	uint64_t fsize; //total image size
+};
+
+struct GffImgSeq {
+	uint32_t name;
+	uint32_t first; //first record on this sequence
+	uint32_t count;
+	uint32_t maxspan; //longest record on this sequence
+};
+
+enum GffImgCol { //record columns
+	gimgStart=0, gimgEnd, gimgCDStart, gimgCDEnd, gimgSeq, gimgID, gimgGeneID,
+	gimgGeneName, gimgFeature, gimgParent, gimgExonOfs, gimgExonCount,
+	GFFIMG_NUMCOLS
+};
+
+//GffImageRec -- lightweight view of a record in a GffImage, mirroring the GffObj getters
+class GffImageRec {
+	const GffImage* img;
+	uint idx;
+	const char* str(uint sofs);
+	uint32_t col(GffImgCol c);
+ public:
+	uint start;
+	uint end;
+	uint CDstart;
+	uint CDend;
+	char strand;
+	GffImageRec(const GffImage* image, uint i);
+	uint getIndex() { return idx; }
+	const char* getID() { return str(col(gimgID)); }
+	const char* getGeneID() { return str(col(gimgGeneID)); }
+	const char* getGeneName() { return str(col(gimgGeneName)); }
+	const char* getGSeqName();
+	const char* getFeatureName() { return str(col(gimgFeature)); }
+	const char* getAttr(const char* attrname);
+	bool hasCDS() { return (CDstart>0); }
+	int parentIdx();
+	uint len() { return end-start+1; }
+	bool overlap(uint s, uint e) { return (start<=e && s<=end); }
+	int exonCount() { return col(gimgExonCount); }
+	void getExons(GVec<GSeg>& exons); //decodes the exon coordinates
+};
+
+//GffImage -- the records of a GfList in a read-only columnar layout, which is
+//mapped in memory and used in place; all processes mapping the same image file
+//share a single copy of it in the page cache
+class GffImage {
+	friend class GffImageRec;
+	char* data;
+	size_t dsize;
+	bool mapped; //data is mmap()ed, not allocated
+	const GffImgHeader* hdr;
+	const GffImgSeq* seqs;
+	const uint32_t* cols;
+	const char* strands;
+	const uchar* exondata;
+	const uint32_t* attrnames;
+	const uint32_t* attrcols;
+	const char* strheap;
+	size_t exlen; //exondata size
+	size_t heaplen; //string heap size
+	GHash<int>* attrids; //attribute name => column
+	bool validate(); //checks the header and the tables against the image size
+ public:
+	//writes an image file for the (finalized) records in gflst
+	static bool build(const char* fname, GfList& gflst);
+	GffImage(const char* fname=NULL):data(NULL), dsize(0), mapped(false), hdr(NULL),
+			seqs(NULL), cols(NULL), strands(NULL), exondata(NULL), attrnames(NULL),
+			attrcols(NULL), strheap(NULL), exlen(0), heaplen(0), attrids(NULL) {
+		if (fname!=NULL && !open(fname))
+			GError("Error: cannot open annotation image file %s!\n", fname);
+	}
+	~GffImage() { close(); }
+	//maps an image file; fails for a truncated or inconsistent image (record values
+	//are range checked when used)
+	bool open(const char* fname);
+	void close();
+	bool isOpen() { return (hdr!=NULL); }
+	int Count() const { return hdr ? hdr->nrecs : 0; }
+	GffImageRec operator[](int i) const { return GffImageRec(this, i); }
+	GffImageRec Get(int i) const { return GffImageRec(this, i); }
+	int seqCount() const { return hdr ? hdr->nseqs : 0; }
+	const char* seqName(int s) const { return strheap+seqs[s].name; }
+	int seqIndex(const char* gseq) const; //-1 if not found
+	int attrCount() const { return hdr ? hdr->nattrs : 0; }
+	const char* attrName(int a) const { return strheap+attrnames[a]; }
+	int attrIndex(const char* attrname) const; //-1 if not found
+	//adds to idxs the indexes of the records overlapping start..end on gseq;
+	//returns the number of records found
+	int findOverlaps(const char* gseq, uint start, uint end, GVec<int>& idxs) const;
+};
+
+inline uint32_t GffImageRec::col(GffImgCol c) { return img->cols[(size_t)c*img->hdr->nrecs+idx]; }
+inline const char* GffImageRec::str(uint sofs) {
+	return (sofs==GFFIMG_NONE || sofs>=img->heaplen) ? NULL : img->strheap+sofs;
+}
+
+#endif /* GFFIMAGE_H_ */
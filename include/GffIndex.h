@@ -0,0 +1,64 @@
+/*
+ * GffIndex.h
+ *
+ *  region index for GFF/GTF/BED files (plain or BGZF compressed)
+ */
+
+#ifndef GFFINDEX_H_
+#define GFFINDEX_H_
+
+#include "GBase.h"
+#include "GHash.hh"
+#include "GList.hh"
+
+#define GFFIDX_WINSHIFT 14 //16kb windows, like the linear index of tabix
+#define GFFIDX_EXT ".gfi" //default index file name suffix
+
+//indexing data for one genomic sequence
+class GffIdxSeq {
+ public:
+	char* name; //the key in GffIndex::seqs
+	int maxspan; //length of the longest record on this sequence
+	GDynArray<int64> wmin; //first (virtual) offset of the lines starting in each window, -1 if none
+	GDynArray<int64> wmax; //offset of the last line starting in each window
+	GffIdxSeq():name(NULL), maxspan(0), wmin(), wmax() { }
+	void addLine(uint start, int64 voff) {
+		uint w=start>>GFFIDX_WINSHIFT;
+		while (wmin.Count()<=w) { wmin.Add(-1); wmax.Add(-1); }
+		if (wmin[w]<0 || voff<wmin[w]) wmin[w]=voff;
+		if (voff>wmax[w]) wmax[w]=voff;
+	}
+	void addSpan(int span) { if (span>maxspan) maxspan=span; }
+};
+
+//GffIndex -- in the spirit of tabix: for each window of each genomic sequence, the range
+//of file offsets of the lines starting there; with BGZF files these are virtual offsets
+//(block file offset<<16 | offset in the decompressed block)
+//All the lines of any record overlapping a region are found between the offsets returned
+//by getRange(), even for records crossing BGZF block boundaries or window boundaries
+//(the input should be sorted by coordinate for these ranges to be short)
+class GffIndex {
+	GPVec<GffIdxSeq> seqlist; //in the order they were added
+ public:
+	GHash<GffIdxSeq> seqs;
+	GffIndex():seqlist(false), seqs(true) { }
+	GffIdxSeq* addSeq(const char* gseq) {
+		GffIdxSeq* s=seqs.Find(gseq);
+		if (s==NULL) {
+			s=new GffIdxSeq();
+			seqs.Add(gseq, s);
+			s->name=seqs.getLastKey();
+			seqlist.Add(s);
+		}
+		return s;
+	}
+	GffIdxSeq* getSeq(const char* gseq) { return seqs.Find(gseq); }
+	int getCount() { return seqlist.Count(); }
+	//the offsets of the first and last line which could belong to a record overlapping
+	//start..end on gseq; returns false if there can be no such records
+	bool getRange(const char* gseq, uint start, uint end, int64& vfrom, int64& vto);
+	int storeIndex(const char* finame); //returns the number of sequences written
+	int loadIndex(const char* finame); //returns the number of sequences loaded
+};
+
+#endif /* GFFINDEX_H_ */
@@ -9,6 +9,11 @@
 #include "GFaSeqGet.h"
 #include "GList.hh"
 #include "GHash.hh"
+#include "GZReader.h"
+#include "GffIndex.h"
+#include <new>
+#include <atomic>
+#include <mutex>
 
 #ifdef CUFFLINKS
 #include <boost/crc.hpp>  // for boost::crc_32_type
@@ -201,14 +206,76 @@ class BEDLine {
     }
 };
 
+//attribute names recognized by GffLine, found through gffAttrKey()
+enum GffAttrKey {
+	gakNone=-1, gakID=0, gakParent, gakTranscriptID, gakGeneID, gakGeneName,
+	gakGeneNameAlt, //geneName
+	gakGeneSym, gakGene,
+	gakGeneIDAlt, //geneID
+	gakExons, gakExonCount, gakCDS, gakCDSphase, gakLocus, gakGeneSymbol,
+	GFF_NUM_ATTRKEYS
+};
+
+//perfect hash lookup of a known attribute name (case insensitive)
+int8_t gffAttrKey(const char* k, int klen);
+
+//an attribute of the GffLine::info column, as found by GffLine::tokenizeAttrs()
+struct GffAttrTok {
+	int key; //offset of the attribute name in GffLine::line[]
+	int klen;
+	int val; //offset of the (raw) value, after the separator and any spaces
+	int vlen; //up to the ';' ending this attribute
+	int next; //next token with the same kid, or -1
+	char sep; //'=' (GFF3), ' ' (GTF), or 0 if there is no value
+	int8_t kid; //GffAttrKey
+	bool deleted; //extracted as a GffLine field, not a GffObj attribute
+	int16_t numcol; //numeric attribute column (see GffReader::numericAttrs()), or -1
+};
+
+//input dialects, as policies for GffLine::parseKeyAttrs(): once the format is known,
+//the checks for the other formats are compiled out; the clean variants (for known-good
+//annotation sources, see GffReader::cleanAnnotation()) also leave out the legacy/TLF quirks
+struct GffDialectAny { static const bool known=false, gff3=false, clean=false; }; //not detected yet
+struct GffDialectGFF3 { static const bool known=true, gff3=true, clean=false; };
+struct GffDialectGTF { static const bool known=true, gff3=false, clean=false; };
+struct GffDialectGFF3Clean { static const bool known=true, gff3=true, clean=true; };
+struct GffDialectGTFClean { static const bool known=true, gff3=false, clean=true; };
+
 class GffLine {
  protected:
     char* _parents; //stores a copy of the Parent attribute value,
        //with commas replaced by \0
     int _parents_len;
+    char* _par1; //parents[] storage for the common single-parent case
+    char* _vfree; //next free byte in the attribute value area (following line[])
+    bool _ownbuf; //line[] and parents[] were allocated by this object (otherwise they are in an arena)
+    int _akfirst[GFF_NUM_ATTRKEYS]; //first token of each known attribute
     bool parseSegmentList(GVec<GSeg>& segs, char* str);
+    //split info into attribute tokens, in a single pass
+    void tokenizeAttrs(GArena* inplace);
+    //extract the value of a known attribute (with the given separator) into the value area
+    char* _extractAttr(GffAttrKey k, char sep, bool caseStrict=false, bool enforce_GTF2=false, bool deleteAttr=true);
+    //rebuild info from the attributes left and terminate their names and values in line[]
+    void finishAttrs(bool gtf);
+    //the attributes needing quirk handling are absent (TLF exons, legacy GTF without transcript_id)
+    bool cleanAttrs() {
+    	return (_akfirst[gakExons]<0 && (_akfirst[gakTranscriptID]>=0 || exontype!=exgffExon));
+    }
+    //parse the ID/Parent/gene attributes according to the input dialect
+    template <class D> void parseKeyAttrs(GffReader* reader, const char* l, GArena* inplace, bool is_t_data);
+    char* _storeValue(const char* vstart, const char* vend) { //copy a substring into the value area
+    	char* r=_vfree;
+    	int vlen=vend-vstart+1;
+    	memcpy(r, vstart, vlen);
+    	r[vlen]=0;
+    	_vfree+=vlen+1;
+    	return r;
+    }
+    char* _rebase(char* p, GffLine& l) { //move a pointer from l's buffer into this one
+    	return (p==NULL) ? NULL : line+(p-l.line);
+    }
  public:
-    char* dupline; //duplicate of original line
+    char* dupline; //duplicate of original line (a view into the reader's input buffer while parsing)
     char* line; //this will have tabs replaced by \0
     int llen;
     char* gseqname;
@@ -241,6 +308,7 @@ class GffLine {
     	    bool skipLine:1;
     	    bool gffWarnings:1;
     	    bool is_gene_segment:1; //for NCBI's D/J/V/C_gene_segment
+    	    bool is_rna:1; //*RNA feature, its ftype_id is set by GffReader::noteGffLine()
     	};
     };
     int8_t exontype; // gffExonType
@@ -254,77 +322,89 @@ class GffLine {
     char** parents; //for GTF only parents[0] is used
     int num_parents;
     char* ID;     // if a ID=.. attribute was parsed, or a GTF with 'transcript' line (transcript_id)
-    GffLine(GffReader* reader, const char* l); //parse the line accordingly
+    GffAttrTok* attrToks; //the tokens of info; once parsed, those not deleted are the GffObj attributes,
+    int numAttrToks;      //  with their names and values terminated in place (see GffObj::parseAttrs())
+    //parse the line accordingly; with an inplace arena the parsed fields are views
+    // into that arena (e.g. the reader's per-line arena) and dupline points to l, so this
+    // GffLine is only valid while both are (use the copy constructor to keep it)
+    //(once the input format is known, this does not change the reader, see GffReader::noteGffLine())
+    GffLine(GffReader* reader, const char* l, int l_len=-1, GArena* inplace=NULL);
     void discardParent() {
-    	GFREE(_parents);
+    	_parents=NULL;
     	_parents_len=0;
     	num_parents=0;
-    	GFREE(parents);
+    	if (_ownbuf && parents!=&_par1) GFREE(parents);
     	parents=NULL;
     }
     static char* extractGFFAttr(char*& infostr, const char* oline, const char* pre, bool caseStrict=false,
-    		bool enforce_GTF2=false, int* rlen=NULL, bool deleteAttr=true);
+    		bool enforce_GTF2=false, int* rlen=NULL, bool deleteAttr=true, char** vstore=NULL);
     char* extractAttr(const char* pre, bool caseStrict=false, bool enforce_GTF2=false, int* rlen=NULL){
     	return extractGFFAttr(info, dupline, pre, caseStrict, enforce_GTF2, rlen, true);
     }
     char* getAttrValue(const char* pre, bool caseStrict=false, bool enforce_GTF2=false, int* rlen=NULL) {
     	return extractGFFAttr(info, dupline, pre, caseStrict, enforce_GTF2, rlen, false);
     }
-    GffLine(GffLine& l): _parents(NULL), _parents_len(l._parents_len),
-    		dupline(NULL), line(NULL), llen(l.llen), gseqname(NULL), track(NULL),
+    GffLine(GffLine& l, GArena* arena=NULL): _parents(NULL), _parents_len(l._parents_len), _par1(NULL),
+    		_vfree(NULL), _ownbuf(arena==NULL), dupline(NULL), line(NULL), llen(l.llen), gseqname(NULL), track(NULL),
     		ftype(NULL), ftype_id(l.ftype_id), info(NULL), fstart(l.fstart), fend(l.fend),
 			//qstart(l.fstart), qend(l.fend), qlen(l.qlen),
 			score(l.score), score_decimals(l.score_decimals), strand(l.strand), flags(l.flags), exontype(l.exontype),
 			phase(l.phase), cds_start(l.cds_start), cds_end(l.cds_end), exons(l.exons), cdss(l.cdss),
-			gene_name(NULL), gene_id(NULL), parents(NULL), num_parents(l.num_parents), ID(NULL) {
-    	//if (l==NULL || l->line==NULL)
-    	//	GError("Error: invalid GffLine(l)\n");
-    	//memcpy((void*)this, (void*)l, sizeof(GffLine));
-    	GMALLOC(line, llen+1);
-    	memcpy(line, l.line, llen+1);
-    	GMALLOC(dupline, llen+1);
+			gene_name(NULL), gene_id(NULL), parents(NULL), num_parents(l.num_parents), ID(NULL),
+			attrToks(NULL), numAttrToks(l.numAttrToks) {
+    	//one allocation for the tokenized line with its attribute values, followed by dupline
+    	int blen=l._vfree-l.line;
+    	if (arena) line=(char*)arena->alloc(blen+llen+1);
+    	else GMALLOC(line, blen+llen+1);
+    	memcpy(line, l.line, blen);
+    	_vfree=line+blen;
+    	dupline=_vfree;
     	memcpy(dupline, l.dupline, llen+1);
     	//--offsets within line[]
-    	gseqname=line+(l.gseqname-l.line);
-    	track=line+(l.track-l.line);
-    	ftype=line+(l.ftype-l.line);
-    	info=line+(l.info-l.line);
-    	if (num_parents>0 && parents) {
-    		GMALLOC(parents, num_parents*sizeof(char*));
-    		//_parents_len=l->_parents_len; copied above
-    		_parents=NULL; //re-init, forget pointer copy
-    		GMALLOC(_parents, _parents_len);
-    		memcpy(_parents, l._parents, _parents_len);
+    	gseqname=_rebase(l.gseqname, l);
+    	track=_rebase(l.track, l);
+    	ftype=_rebase(l.ftype, l);
+    	info=_rebase(l.info, l);
+    	ID=_rebase(l.ID, l);
+    	gene_name=_rebase(l.gene_name, l);
+    	gene_id=_rebase(l.gene_id, l);
+    	if (num_parents>0 && l.parents) {
+    		_parents=_rebase(l._parents, l);
+    		if (num_parents==1) parents=&_par1;
+    		else if (arena) parents=(char**)arena->alloc(num_parents*sizeof(char*));
+    		else GMALLOC(parents, num_parents*sizeof(char*));
     		for (int i=0;i<num_parents;i++) {
-    			parents[i]=_parents+(l.parents[i] - l._parents);
+    			parents[i]=_rebase(l.parents[i], l);
     		}
     	}
-    	//-- allocated string copies:
-    	ID=Gstrdup(l.ID);
-    	if (l.gene_name!=NULL)
-    		gene_name=Gstrdup(l.gene_name);
-    	if (l.gene_id!=NULL)
-    		gene_id=Gstrdup(l.gene_id);
+    	//token offsets are the same in the copied line[]
+    	memcpy(_akfirst, l._akfirst, sizeof(_akfirst));
+    	if (numAttrToks>0) {
+    		if (arena) attrToks=(GffAttrTok*)arena->alloc(numAttrToks*sizeof(GffAttrTok));
+    		else GMALLOC(attrToks, numAttrToks*sizeof(GffAttrTok));
+    		memcpy(attrToks, l.attrToks, numAttrToks*sizeof(GffAttrTok));
+    	}
     }
-    GffLine(): _parents(NULL), _parents_len(0),
+    GffLine(): _parents(NULL), _parents_len(0), _par1(NULL), _vfree(NULL), _ownbuf(false),
     		dupline(NULL), line(NULL), llen(0), gseqname(NULL), track(NULL),
     		ftype(NULL), ftype_id(-1), info(NULL), fstart(0), fend(0), //qstart(0), qend(0), qlen(0),
     		score(0), score_decimals(-1), strand(0), flags(0), exontype(0), phase(0), cds_start(0), cds_end(0),
-			exons(), cdss(),  gene_name(NULL), gene_id(NULL), parents(NULL), num_parents(0), ID(NULL) {
+			exons(0), cdss(0),  gene_name(NULL), gene_id(NULL), parents(NULL), num_parents(0), ID(NULL),
+			attrToks(NULL), numAttrToks(0) {
+    	memset(_akfirst, 0xFF, sizeof(_akfirst));
     }
     ~GffLine() {
-    	GFREE(dupline);
-    	GFREE(line);
-    	GFREE(_parents);
-    	GFREE(parents);
-    	GFREE(ID);
-    	GFREE(gene_name);
-    	GFREE(gene_id);
+    	if (_ownbuf) {
+    		GFREE(line);
+    		if (parents!=&_par1) GFREE(parents);
+    		GFREE(attrToks);
+    	}
     }
 };
 
 class GffAttr {
  public:
+  GMEM_NEW_DELETE
   union {
     int id_full;
     struct {
@@ -332,27 +412,26 @@ class GffAttr {
       int  attr_id:31;
     };
   };
+  bool pooled; //attr_val is kept in the value storage of a GffAttrs list, not to be freed here
   char* attr_val;
-  GffAttr(int an_id, const char* av=NULL, bool is_cds=false):id_full(0), attr_val(NULL) {
+  GffAttr(int an_id, const char* av=NULL, bool is_cds=false):id_full(0), pooled(false), attr_val(NULL) {
 	 attr_id=an_id;
      setValue(av, is_cds);
   }
   ~GffAttr() {
-     GFREE(attr_val);
+     if (!pooled) GFREE(attr_val);
   }
-  void setValue(const char* av, bool is_cds=false) {
-     if (attr_val!=NULL) {
-        GFREE(attr_val);
-     }
-     if (av==NULL || av[0]==0) return;
+  //trimmed extent vstart..vend of a raw attribute value (NULL if empty)
+  static const char* trimValue(const char* av, const char*& vend) {
+     if (av==NULL || av[0]==0) return NULL;
      //trim spaces
      const char* vstart=av;
-     while (*vstart==' ') av++;
-     const char* vend=vstart;
+     while (*vstart==' ') vstart++;
+     if (*vstart==0) return NULL;
+     vend=vstart;
      bool keep_dq=false;
      while (vend[1]!=0) {
         if (*vend==' ' && vend[1]!=' ') keep_dq=true;
-          else if (*vend==';') keep_dq=true;
         vend++;
      }
      //remove spaces at the end:
@@ -362,6 +441,17 @@ class GffAttr {
                vend--;
                vstart++;
      }
+     return vstart;
+  }
+  void setValue(const char* av, bool is_cds=false) {
+     if (attr_val!=NULL) {
+        if (pooled) attr_val=NULL;
+          else GFREE(attr_val);
+     }
+     pooled=false;
+     const char* vend=NULL;
+     const char* vstart=trimValue(av, vend);
+     if (vstart==NULL) return;
      attr_val=Gstrdup(vstart, vend);
      cds=is_cds;
   }
@@ -380,13 +470,18 @@ class GffAttr {
 class GffNameList;
 class GffNames;
 
+//hash of the names in a GffNameList (gene ids share long prefixes, which the ELF hash
+//packed into a few clustered values)
+inline uint gffNameHash(const char* n) { return (uint)gstrhash64(n, strlen(n)); }
+
 class GffNameInfo {
   friend class GffNameList;
  public:
    int idx;
    char* name;
-   GffNameInfo(const char* n=NULL):idx(-1),name(NULL) {
-     if (n) name=Gstrdup(n);
+   uint hash; //of name, cached for the lookups
+   GffNameInfo(const char* n=NULL):idx(-1),name(NULL),hash(0) {
+     if (n) { name=Gstrdup(n); hash=gffNameHash(n); }
      }
 
    ~GffNameInfo() {
@@ -401,83 +496,113 @@ class GffNameInfo {
      }
 };
 
-class GffNameList:public GPVec<GffNameInfo> {
+#define GFFNAMES_SEGBITS 6 //the first id segment holds 64 names, each next one twice as many
+#define GFFNAMES_MAXSEGS 26
+
+//GffNameList -- interning table for names, handing out stable integer ids;
+//lookups (getId(), getName(), Get(), Count()) are lock-free and can run on any thread,
+//while new names are added under a mutex, so multiple threads can intern names concurrently.
+//The ids are stored in segments which are never moved, and the hash table (open addressing,
+//linear probing) is replaced as a whole when it grows, so readers always see a consistent
+//table; the old tables are only freed with the GffNameList
+class GffNameList {
   friend class GffNameInfo;
   friend class GffNames;
 protected:
-  GHash<GffNameInfo> byName;//hash with shared keys
-  int idlast; //fList index of last added/reused name
-  int addStatic(const char* tname) {// fast add
-     GffNameInfo* f=new GffNameInfo(tname);
-     idlast=this->Add(f);
-     f->idx=idlast;
-     byName.shkAdd(f->name,f);
-     return idlast;
+  struct NameTable {
+     uint mask; //capacity-1
+     std::atomic<GffNameInfo*>* slots;
+     NameTable* prev; //retired table
+     NameTable(uint cap, NameTable* older):mask(cap-1), slots(NULL), prev(older) {
+        slots=new std::atomic<GffNameInfo*>[cap];
+        for (uint i=0;i<cap;i++) slots[i].store(NULL, std::memory_order_relaxed);
+        }
+     ~NameTable() { delete[] slots; }
+  };
+  std::atomic<NameTable*> table;
+  std::atomic<GffNameInfo**> segs[GFFNAMES_MAXSEGS]; //id => name entry
+  std::atomic<int> fCount;
+  std::atomic<int> idlast; //index of last added/reused name
+  std::mutex addlock;
+  static int segIndex(int id, int& ofs) {
+     uint v=((uint)id>>GFFNAMES_SEGBITS)+1;
+     int sg=31-__builtin_clz(v);
+     ofs=id-(((1<<sg)-1)<<GFFNAMES_SEGBITS);
+     return sg;
      }
+  GffNameInfo* findName(const char* tname, uint h) const {
+     NameTable* t=table.load(std::memory_order_acquire);
+     for (uint i=h & t->mask;;i=(i+1) & t->mask) {
+        GffNameInfo* f=t->slots[i].load(std::memory_order_acquire);
+        if (f==NULL) return NULL;
+        if (f->hash==h && strcmp(f->name, tname)==0) return f;
+        }
+     }
+  int insertName(const char* tname, uint h); //adds the name if still not found, under addlock
+  int addStatic(const char* tname) { return insertName(tname, gffNameHash(tname)); }
 public:
- //GffNameList(int init_capacity=6):GList<GffNameInfo>(init_capacity, false,true,true), byName(false) {
-  GffNameList(int init_capacity=6):GPVec<GffNameInfo>(init_capacity, true), byName(false) {
-    idlast=-1;
-    setCapacity(init_capacity);
-    }
- char* lastNameUsed() { return idlast<0 ? NULL : Get(idlast)->name; }
- int lastNameId() { return idlast; }
- char* getName(int nid) { //retrieve name by its ID
-   if (nid<0 || nid>=fCount)
+  GffNameList(int init_capacity=6);
+  ~GffNameList();
+  int Count() const { return fCount.load(std::memory_order_acquire); }
+  GffNameInfo* Get(int nid) const {
+     int ofs=0;
+     int sg=segIndex(nid, ofs);
+     return segs[sg].load(std::memory_order_acquire)[ofs];
+     }
+  char* lastNameUsed() { int i=idlast.load(std::memory_order_relaxed); return i<0 ? NULL : Get(i)->name; }
+  int lastNameId() { return idlast.load(std::memory_order_relaxed); }
+  char* getName(int nid) const { //retrieve name by its ID
+     if (nid<0 || nid>=Count())
          GError("GffNameList Error: invalid index (%d)\n",nid);
-   return fList[nid]->name;
-   }
+     return Get(nid)->name;
+     }
 
- int addName(const char* tname) {//returns or create an id for the given name
-   //check idlast first, chances are it's the same feature name checked
-   /*if (idlast>=0 && strcmp(fList[idlast]->name,tname)==0)
-       return idlast;*/
-   GffNameInfo* f=byName.Find(tname);
-   int fidx=-1;
-   if (f!=NULL) fidx=f->idx;
-     else {//add new entry
-      f=new GffNameInfo(tname);
-      fidx=this->Add(f);
-      f->idx=fidx;
-      byName.shkAdd(f->name,f);
-      }
-   idlast=fidx;
-   return fidx;
-   }
+  int addName(const char* tname) {//returns or create an id for the given name
+     uint h=gffNameHash(tname);
+     GffNameInfo* f=findName(tname, h);
+     int fidx=(f!=NULL) ? f->idx : insertName(tname, h);
+     idlast.store(fidx, std::memory_order_relaxed);
+     return fidx;
+     }
 
- int addNewName(const char* tname) {
-    GffNameInfo* f=new GffNameInfo(tname);
-    int fidx=this->Add(f);
-    f->idx=fidx;
-    byName.shkAdd(f->name,f);
-    return fidx;
-    }
+  //for a name not found by getId() (with concurrent adds it might have been added meanwhile,
+  //so this is the same as addName())
+  int addNewName(const char* tname) {
+     return insertName(tname, gffNameHash(tname));
+     }
 
- int getId(const char* tname) { //only returns a name id# if found
-    GffNameInfo* f=byName.Find(tname);
-    if (f==NULL) return -1;
-    return f->idx;
-    }
- int removeName() {
-   GError("Error: removing names from GffNameList not allowed!\n");
-   return -1;
-   }
+  char* internName(const char* tname) { //the dictionary's own copy of tname, added if needed
+     return Get(addName(tname))->name;
+     }
+
+  int getId(const char* tname) const { //only returns a name id# if found
+     GffNameInfo* f=findName(tname, gffNameHash(tname));
+     if (f==NULL) return -1;
+     return f->idx;
+     }
+  int removeName() {
+     GError("Error: removing names from GffNameList not allowed!\n");
+     return -1;
+     }
 };
 
+//GffNames -- the dictionaries of a GffReader, referenced by all its GffObj records
+//(they can also be shared by multiple readers, see GffReader::setNames())
 class GffNames {
  public:
-   int numrefs;
+   std::atomic<int> numrefs;
    GffNameList tracks;
    GffNameList gseqs;
    GffNameList attrs;
    GffNameList feats; //feature names: 'mRNA', 'exon', 'CDS' etc.
-   GffNames():tracks(),gseqs(),attrs(), feats() {
+   GffNameList genes; //gene ids and gene names of the records (GffObj::geneID, gene_name)
+   GffNames():tracks(),gseqs(),attrs(), feats(), genes() {
     numrefs=0;
     //the order below is critical!
-    //has to match: gff_fid_mRNA, gff_fid_exon
-    gff_fid_mRNA = feats.addStatic("mRNA");//index 0=gff_fid_mRNA
-    gff_fid_transcript=feats.addStatic("transcript");//index 1=gff_fid_transcript
-    gff_fid_exon=feats.addStatic("exon");//index 1=gff_fid_exon
+    //has to match: gff_fid_mRNA, gff_fid_transcript, gff_fid_exon
+    feats.addStatic("mRNA");//index 0=gff_fid_mRNA
+    feats.addStatic("transcript");//index 1=gff_fid_transcript
+    feats.addStatic("exon");//index 2=gff_fid_exon
     //feats.addStatic("CDS"); //index 2=gff_fid_CDS
     }
 };
@@ -500,32 +625,150 @@ enum GffPrintMode {
 };
 
 
-class GffAttrs:public GList<GffAttr> {
+#define GFFATTRS_INLINE 4 //attributes stored in the GffAttrs object itself
+#define GFFATTRS_VALCHUNK 64 //minimum size of the value storage chunks after the first one
+
+//attributes of a record or segment in a flat array, in their input order (which is also
+//the output order); up to GFFATTRS_INLINE entries need no extra allocation.
+//Values are copied into chunks owned by the list, which are never moved, so an attr_val
+//stays valid until that attribute is updated or removed, or the list is cleared; the
+//first chunk is only as large as the values stored (or reserved) at first, and an
+//updated value is written over the old one when it fits.
+//A list can have more than one owner (see ref()/unref()); a shared list is read-only,
+//owners call own() to get a private copy before changing it.
+class GffAttrs {
+  friend class GffAttrsPool;
+  protected:
+    struct ValChunk {
+      ValChunk* next;
+      int cap;
+      int used;
+      char* data() { return (char*)(this+1); }
+    };
+    GffAttr* fList;
+    int fCount;
+    int fCapacity;
+    ValChunk* vals; //most recent chunk first
+    std::atomic<int> numrefs;
+    uint64_t chash; //content hash, set by GffAttrsPool
+    alignas(GffAttr) char fInline[GFFATTRS_INLINE*sizeof(GffAttr)];
+    char* storeValue(const char* vstart, const char* vend); //copy of vstart..vend
+    char* replaceValue(GffAttr& a, const char* vstart, const char* vend); //new value of a
+    void freeVal(GffAttr& a) {
+      if (!a.pooled) GFREE(a.attr_val);
+      a.attr_val=NULL;
+      a.pooled=false;
+    }
+    GffAttr& newEntry(int aid) {
+      if (fCount==fCapacity) Grow();
+      GffAttr& a=fList[fCount++];
+      a.id_full=0;
+      a.attr_id=aid;
+      a.pooled=false;
+      a.attr_val=NULL;
+      return a;
+    }
+    void Grow();
   public:
-    GffAttrs():GList<GffAttr>(false,true,true) { }
+    GMEM_NEW_DELETE
+    GffAttrs():fList((GffAttr*)fInline), fCount(0), fCapacity(GFFATTRS_INLINE), vals(NULL),
+        numrefs(1), chash(0) { }
+    GffAttrs(const GffAttrs&)=delete;
+    GffAttrs& operator=(const GffAttrs&)=delete;
+    ~GffAttrs() { Clear(); }
+    GffAttrs* ref() { ++numrefs; return this; }
+    static void unref(GffAttrs*& a) {
+      if (a!=NULL && --(a->numrefs)==0) delete a;
+      a=NULL;
+    }
+    bool shared() { return numrefs>1; }
+    GffAttrs* clone(); //exact, unshared copy
+    static GffAttrs* own(GffAttrs*& a) { //copy-on-write: a becomes a private list
+      if (a!=NULL && a->shared()) {
+        GffAttrs* c=a->clone();
+        unref(a);
+        a=c;
+      }
+      return a;
+    }
+    bool sameAs(GffAttrs& o); //same entries, values and order
+    uint64_t contentHash();
+    int Count() { return fCount; }
+    GffAttr* Get(int i) {
+      TEST_INDEX(i);
+      return &fList[i];
+    }
+    GffAttr* operator[](int i) { return Get(i); }
+    int Add(int aid, const char* av, bool is_cds=false) {
+      //same value clean-up as GffAttr::setValue()
+      GffAttr& a=newEntry(aid);
+      const char* vend=NULL;
+      const char* vstart=GffAttr::trimValue(av, vend);
+      if (vstart!=NULL) {
+        a.attr_val=storeValue(vstart, vend);
+        a.pooled=true;
+        a.cds=is_cds;
+      }
+      return fCount-1;
+    }
+    int Add(GffAttr* attr) { //takes over attr (deleted here)
+      if (attr==NULL) return -1;
+      GffAttr& a=newEntry(0);
+      a.id_full=attr->id_full;
+      if (attr->attr_val!=NULL) {
+        a.attr_val=storeValue(attr->attr_val, attr->attr_val+strlen(attr->attr_val)-1);
+        a.pooled=true;
+      }
+      delete attr;
+      return fCount-1;
+    }
+    void setValue(int i, const char* av, bool is_cds=false) {
+      GffAttr& a=*Get(i);
+      const char* vend=NULL;
+      const char* vstart=GffAttr::trimValue(av, vend);
+      if (vstart==NULL) { freeVal(a); return; }
+      a.attr_val=replaceValue(a, vstart, vend);
+      a.pooled=true;
+      a.cds=is_cds;
+    }
+    //room for n entries and, in the first value chunk, for vlen bytes of values (with the NULs)
+    void reserve(int n, int vlen);
+    void freeItem(int i) { //the entry is dropped by the next Pack()
+      GffAttr& a=*Get(i);
+      freeVal(a);
+      a.attr_id=-1;
+    }
+    void Pack(); //remove the entries released by freeItem()
+    void Delete(int i) {
+      freeVal(*Get(i));
+      --fCount;
+      if (i<fCount) memmove((void*)&fList[i], (void*)&fList[i+1], (fCount-i)*sizeof(GffAttr));
+    }
+    void Clear(); //also releases the value storage
+
     void add_if_new(GffNames* names, const char* attrname, const char* attrval) {
         //adding a new value without checking for cds status
         int nid=names->attrs.getId(attrname);
         if (nid>=0) { //attribute name found in the dictionary
-           for (int i=0;i<Count();i++)
-              if (nid==Get(i)->attr_id) { return; } //don't update existing
+           for (int i=0;i<fCount;i++)
+              if (nid==fList[i].attr_id) { return; } //don't update existing
         }
         else { //adding attribute name to global attr name dictionary
            nid=names->attrs.addNewName(attrname);
         }
-        this->Add(new GffAttr(nid, attrval));
+        Add(nid, attrval);
     }
 
     void add_if_new(GffNames* names, const char* attrname, const char* attrval, bool is_cds) {
         int nid=names->attrs.getId(attrname);
         if (nid>=0) { //attribute name found in the dictionary
-           for (int i=0;i<Count();i++)
-              if (nid==Get(i)->attr_id && is_cds==Get(i)->cds) { return; } //don't update existing
+           for (int i=0;i<fCount;i++)
+              if (nid==fList[i].attr_id && is_cds==fList[i].cds) { return; } //don't update existing
         }
         else { //adding attribute name to global attr name dictionary
            nid=names->attrs.addNewName(attrname);
         }
-        this->Add(new GffAttr(nid, attrval, is_cds));
+        Add(nid, attrval, is_cds);
     }
 
     void add_or_update(GffNames* names, const char* attrname, const char* val) {
@@ -533,11 +776,11 @@ class GffAttrs:public GList<GffAttr> {
         int aid=names->attrs.getId(attrname);
         if (aid>=0) {
            //attribute found in the dictionary
-           for (int i=0;i<Count();i++) {
+           for (int i=0;i<fCount;i++) {
               //do we have it?
-              if (aid==Get(i)->attr_id) {
+              if (aid==fList[i].attr_id) {
                   //update the existing value for this attribute
-                  Get(i)->setValue(val);
+                  setValue(i, val);
                   return;
                   }
               }
@@ -545,18 +788,18 @@ class GffAttrs:public GList<GffAttr> {
         else { //adding attribute name to global attr name dictionary
            aid=names->attrs.addNewName(attrname);
         }
-        this->Add(new GffAttr(aid, val));
+        Add(aid, val);
     }
 
     void add_or_update(GffNames* names, const char* attrname, const char* val, bool is_cds) {
       int aid=names->attrs.getId(attrname);
       if (aid>=0) {
          //attribute found in the dictionary
-         for (int i=0;i<Count();i++) {
+         for (int i=0;i<fCount;i++) {
             //do we have it?
-            if (aid==Get(i)->attr_id && Get(i)->cds==is_cds) {
+            if (aid==fList[i].attr_id && fList[i].cds==is_cds) {
                 //update the existing value for this attribute
-                Get(i)->setValue(val, is_cds);
+                setValue(i, val, is_cds);
                 return;
                 }
             }
@@ -564,12 +807,12 @@ class GffAttrs:public GList<GffAttr> {
       else { //adding attribute name to global attr name dictionary
          aid=names->attrs.addNewName(attrname);
       }
-      this->Add(new GffAttr(aid, val, is_cds));
+      Add(aid, val, is_cds);
     }
 
     int haveId(int attr_id, bool is_cds=false) {
-        for (int i=0;i<Count();i++)
-           if (attr_id==Get(i)->attr_id && Get(i)->cds==is_cds)
+        for (int i=0;i<fCount;i++)
+           if (attr_id==fList[i].attr_id && fList[i].cds==is_cds)
         	   return i;
         return -1;
     }
@@ -577,8 +820,8 @@ class GffAttrs:public GList<GffAttr> {
     int haveId(const char* attrname, GffNames* names, bool is_cds=false) {
     	int aid=names->attrs.getId(attrname);
     	if (aid>=0) {
-            for (int i=0;i<Count();i++)
-               if (aid==Get(i)->attr_id && Get(i)->cds==is_cds)
+            for (int i=0;i<fCount;i++)
+               if (aid==fList[i].attr_id && fList[i].cds==is_cds)
             	   return i;
     	}
     	return -1;
@@ -587,31 +830,31 @@ class GffAttrs:public GList<GffAttr> {
     char* getAttr(GffNames* names, const char* attrname) {
       int aid=names->attrs.getId(attrname);
       if (aid>=0)
-        for (int i=0;i<Count();i++)
-          if (aid==Get(i)->attr_id) return Get(i)->attr_val;
+        for (int i=0;i<fCount;i++)
+          if (aid==fList[i].attr_id) return fList[i].attr_val;
       return NULL;
     }
 
     char* getAttr(GffNames* names, const char* attrname, bool is_cds) {
       int aid=names->attrs.getId(attrname);
       if (aid>=0)
-        for (int i=0;i<Count();i++)
-          if (aid==Get(i)->attr_id && Get(i)->cds==is_cds) return Get(i)->attr_val;
+        for (int i=0;i<fCount;i++)
+          if (aid==fList[i].attr_id && fList[i].cds==is_cds) return fList[i].attr_val;
       return NULL;
     }
 
     char* getAttr(int aid) {
       if (aid>=0)
-        for (int i=0;i<Count();i++)
-          if (aid==Get(i)->attr_id) return Get(i)->attr_val;
+        for (int i=0;i<fCount;i++)
+          if (aid==fList[i].attr_id) return fList[i].attr_val;
       return NULL;
     }
 
     char* getAttr(int aid, bool is_cds) {
       if (aid>=0)
-        for (int i=0;i<Count();i++)
-          if (aid==Get(i)->attr_id && Get(i)->cds==is_cds)
-            return Get(i)->attr_val;
+        for (int i=0;i<fCount;i++)
+          if (aid==fList[i].attr_id && fList[i].cds==is_cds)
+            return fList[i].attr_val;
       return NULL;
     }
 
@@ -622,15 +865,36 @@ class GffAttrs:public GList<GffAttr> {
     	for (int i=0;i<attrs->Count();i++) {
     		int aid=attrs->Get(i)->attr_id;
     		if (haveId(aid, is_cds)<0)
-    			Add(new GffAttr(aid, attrs->Get(i)->attr_val, is_cds));
+    			Add(aid, attrs->Get(i)->attr_val, is_cds);
     	}
     }
 };
 
+//hash-consing of attribute lists: identical lists are replaced by a single shared one,
+//which holds a reference from the pool until Clear()
+class GffAttrsPool {
+    GffAttrs** slots; //open addressing, linear probing
+    int cap; //power of 2
+    int count;
+    void Grow();
+  public:
+    GffAttrsPool():slots(NULL), cap(0), count(0) { }
+    GffAttrsPool(const GffAttrsPool&)=delete;
+    GffAttrsPool& operator=(const GffAttrsPool&)=delete;
+    ~GffAttrsPool() { Clear(); }
+    //return the pooled list with the same content as a (releasing a), or a itself, now pooled
+    GffAttrs* intern(GffAttrs* a);
+    int Count() { return count; }
+    void Clear();
+};
+
 class GffExon : public GSeg {
  public:
-  bool sharedAttrs; //do not free attrs on destruct!
-  GffAttrs* attrs; //other attributes kept for this exon/CDS
+  GMEM_NEW_DELETE
+  bool sharedAttrs; //attrs are only borrowed: not referenced, not released on destruct
+  bool packed; //lives in its GffObj's exblock (see GffObj::packExons()), never freed on its own
+              //(GffObj::detachExon() hands out a copy)
+  GffAttrs* attrs; //other attributes kept for this exon/CDS (can be shared, see GffAttrs::own())
   GffScore score; // gff score column
   int8_t exontype;
   char phase; //GFF phase column - for CDS segments only!
@@ -646,10 +910,10 @@ class GffExon : public GSeg {
     if (attrs==NULL) return NULL;
     return attrs->getAttr(aid);
   }
-  GffExon(bool share_attributes):GSeg(0,0), sharedAttrs(share_attributes), attrs(NULL), score(),
+  GffExon(bool share_attributes):GSeg(0,0), sharedAttrs(share_attributes), packed(false), attrs(NULL), score(),
 		  exontype(0), phase('.'), uptr(NULL){
   }
-  GffExon(uint s=0, uint e=0, int8_t et=0, char ph='.', float sc=0, int8_t sc_prec=0):sharedAttrs(false), attrs(NULL),
+  GffExon(uint s=0, uint e=0, int8_t et=0, char ph='.', float sc=0, int8_t sc_prec=0):sharedAttrs(false), packed(false), attrs(NULL),
 		  score(sc,sc_prec), exontype(et), phase(ph), uptr(NULL) {
 		if (s<e) { start=s; end=e; }
 		    else { start=e; end=s; }
@@ -657,23 +921,41 @@ class GffExon : public GSeg {
   } //constructor
 
 
-  GffExon(const GffExon& ex):GSeg(ex.start, ex.end) { //copy constructor
-      (*this)=ex; //use the default (shallow!) copy operator
-      if (ex.attrs!=NULL) { //make a deep copy here
-        attrs=new GffAttrs();
-        attrs->copyAttrs(ex.attrs);
+  GffExon(const GffExon& ex):GSeg(ex.start, ex.end), packed(false) { //copy constructor
+      (*this)=ex; //shallow copy
+      //copied on write, see GffAttrs::own(); a copy of a segment borrowing its list also
+      //takes a reference, as it can outlive the list's owner (e.g. after setCDS(t))
+      if (attrs!=NULL) {
+        attrs->ref();
+        sharedAttrs=false;
       }
   }
 
-  GffExon& operator=(const GffExon& o) = default; //prevent gcc 9 warnings:
-                                           //yes, I want a shallow copy here
+  GffExon& operator=(const GffExon& o) { //shallow copy, keeping our own storage flag
+      start=o.start;
+      end=o.end;
+      sharedAttrs=o.sharedAttrs;
+      attrs=o.attrs;
+      score=o.score;
+      exontype=o.exontype;
+      phase=o.phase;
+      uptr=o.uptr;
+      return *this;
+  }
 
   ~GffExon() { //destructor
-     if (attrs!=NULL && !sharedAttrs) delete attrs;
+     if (!sharedAttrs) GffAttrs::unref(attrs);
   }
 
 };
 
+//packed exons are only destroyed, their memory belongs to the owning GffObj
+template<> inline void GPVec<GffExon>::DefaultFreeProc(pointer item) {
+  GffExon* ex=(GffExon*)item;
+  if (ex->packed) ex->~GffExon();
+    else delete ex;
+}
+
 //only for mapping to spliced coding sequence:
 class GffCDSeg:public GSeg {
  public:
@@ -685,6 +967,10 @@ class GffCDSeg:public GSeg {
 class GffObj:public GSeg {
  protected:
    char* gffID; // ID name for mRNA (parent) feature
+   //gene_name and geneID are set with setGeneName() and setGeneID(); for the records kept
+   //by a GffReader (readAll(), readRegion(), loadSnapshot()) they are strings of names->genes,
+   //shared by all the records of a gene (so equal values have equal pointers), otherwise
+   //(e.g. readNext() records) they are own copies, see flag_GENE_DICT
    char* gene_name; //value of gene_name attribute (GTF) if present or Name attribute of the parent gene feature (GFF3)
    char* geneID; //value of gene_id attribute (GTF) if present, or the ID attribute of a parent gene feature (GFF3)
    union {
@@ -709,6 +995,9 @@ class GffObj:public GSeg {
     	  bool flag_LST_KEEP          :1; //controlled by isUsed(); if set, this GffObj will not be
     	                                  //deallocated when GffReader is destroyed
     	  bool flag_FINALIZED         :1; //if finalize() was already called for this GffObj
+    	  bool flag_SEG_BOUNDS        :1; //exons_maxlen/cdss_maxlen are tracked (set while a GffReader builds it)
+    	  bool flag_LAZY_ATTRS        :1; //record attributes may be kept raw in rawattrs until first read
+    	  bool flag_GENE_DICT         :1; //gene_name and geneID are names->genes strings, not own copies
     	  unsigned int gff_level      :4; //hierarchical level (0..15)
       };
    };
@@ -716,7 +1005,8 @@ class GffObj:public GSeg {
    friend class GffReader;
    friend class GffExon;
 public:
-  static GffNames* names; // dictionary storage that holds the various attribute names etc.
+  GMEM_NEW_DELETE
+  GffNames* names; // dictionaries holding the various attribute names etc. (of the GffReader)
   int track_id; // index of track name in names->tracks
   int gseq_id; // index of genomic sequence name in names->gseqs
   int ftype_id; // index of this record's feature name in names->feats, or the special gff_fid_mRNA value
@@ -725,6 +1015,9 @@ public:
   GList<GffExon> exons; //for non-mRNA entries, these can be any subfeature of type subftype_id
   GList<GffExon>* cdss; //only !NULL for cases of "programmed frameshift" when CDS boundaries do not match
                       //exons boundaries
+  //after finalize() the exons and cdss segments are packed in exblock (GffExon::packed): they
+  //can be removed with removeExon() or the lists' Delete(), but not taken out with Forget()
+  //and deleted or moved to another record, use detachExon() for that
   GPVec<GffObj> children;
   GffObj* parent;
   int udata; //user data, flags etc.
@@ -779,6 +1072,10 @@ public:
 
   int addExon(uint segstart, uint segend, int8_t exontype=exgffNone, char phase='.',
 		      GffScore exon_score=GFFSCORE_NONE, GList<GffExon>* segs=NULL);
+  //take segment i out of exons (or segs), leaving a NULL in its place as Forget() does
+  //(Pack() the list afterwards); the caller owns the returned segment, which is a
+  //separately allocated copy if the segment was packed
+  GffExon* detachExon(int i, GList<GffExon>* segs=NULL);
 
 protected:
   bool reduceExonAttrs(GList<GffExon>& segs);
@@ -787,37 +1084,70 @@ protected:
        int8_t exontype);
   bool processGeneSegments(GffReader* gfr); //for genes that have _gene_segment features (NCBI annotation)
   void transferCDS(GffExon* cds);
+  //lazy attributes: segments of [mode][pair count (2 bytes)] followed by name\0value\0 pairs,
+  //replayed in order by loadAttrs() as the eager parseAttrs() calls would have done
+  char* rawattrs;
+  int rawattrs_len;
+  void stashAttrs(GffLine& gl, bool exon2transcript, bool CDSsrc);
+  void loadAttrs();
+  void shareExonAttrs(GffAttrsPool& pool); //identical exon/CDS attribute lists become one
+  //longest segment seen in exons/cdss while flag_SEG_BOUNDS is set; no segment can
+  //overlap s..e unless it starts at or after s-maxlen, so exonOverlapIdx() can skip ahead
+  uint exons_maxlen;
+  uint cdss_maxlen;
+  void segMaxLen(GList<GffExon>& segs, uint len) {
+	  if (&segs==&exons) { if (len>exons_maxlen) exons_maxlen=len; }
+	  else if (len>cdss_maxlen) cdss_maxlen=len;
+  }
 public:
   void removeExon(int idx);
   void removeExon(GffExon* p);
   char  strand; //true if features are on the reverse complement strand
   GffScore gscore;
   int covlen; //total coverage of reference genomic sequence (sum of maxcf segment lengths)
+  int numrow; //row of this record in its reader's numeric attribute columns, or -1
   GffAttrs* attrs; //other gff3 attributes found for the main mRNA feature
+                   //(with GffReader::lazyAttrs() use getAttrs() instead of reading this directly)
+  GffExon* exblock; //contiguous storage for the exons and cdss segments, see packExons()
    //constructor by gff line parsing:
   GffObj(GffReader& gfrd, BEDLine& bedline);
-  GffObj(GffReader& gfrd, GffLine& gffline);
+  //(geneDict: intern the gene name and id in names->genes, for the records kept by gfrd)
+  GffObj(GffReader& gfrd, GffLine& gffline, bool geneDict=false);
    //if gfline->Parent!=NULL then this will also add the first sub-feature
    // otherwise, only the main feature is created
   void copyAttrs(GffObj* from);
+  GffAttrs* getAttrs() { //record attributes, parsing any raw ones first
+    if (rawattrs!=NULL) loadAttrs();
+    return attrs;
+  }
   void clearAttrs() {
+    GFREE(rawattrs);
+    rawattrs_len=0;
     if (attrs!=NULL) {
       bool sharedattrs=(exons.Count()>0 && exons[0]->attrs==attrs);
-      delete attrs; attrs=NULL;
+      GffAttrs::unref(attrs);
       if (sharedattrs) exons[0]->attrs=NULL;
       }
     }
-  GffObj(char* anid=NULL):GSeg(0,0), exons(true,true,false), cdss(NULL), children(1,false), gscore() {
+  //records created outside of a GffReader get their own dictionaries, unless gnames is given
+  GffObj(char* anid=NULL, GffNames* gnames=NULL):GSeg(0,0), exons(true,true,false), cdss(NULL),
+		  children(1,false), gscore() {
                                    //exons: sorted, free, non-unique
        gffID=NULL;
        uptr=NULL;
        ulink=NULL;
        flags=0;
+       exblock=NULL;
+       rawattrs=NULL;
+       rawattrs_len=0;
+       exons_maxlen=0;
+       cdss_maxlen=0;
        udata=0;
        parent=NULL;
        ftype_id=-1;
        subftype_id=-1;
        if (anid!=NULL) gffID=Gstrdup(anid);
+       names=gnames;
        gffnames_ref(names);
        CDstart=0; // hasCDS <=> CDstart>0
        CDend=0;
@@ -827,21 +1157,29 @@ public:
        strand='.';
        attrs=NULL;
        covlen=0;
+       numrow=-1;
        geneID=NULL;
        gene_name=NULL;
    }
    ~GffObj() {
        GFREE(gffID);
-       GFREE(gene_name);
-       GFREE(geneID);
+       if (!flag_GENE_DICT) {
+          GFREE(gene_name);
+          GFREE(geneID);
+       }
        delete cdss;
        clearAttrs();
+       exons.Clear(); //packed exons must go before their block
+       GFREE(exblock);
        gffnames_unref(names);
        }
    //--------------
    GffObj* finalize(GffReader* gfr);
                //complete parsing: must be called in order to merge adjacent/close proximity subfeatures
+   void packExons(); //move exons and cdss segments into a single contiguous block
    void parseAttrs(GffAttrs*& atrlist, char* info, bool isExon=false, bool CDSsrc=false);
+   //same as above, from the attribute tokens of a parsed GffLine
+   void parseAttrs(GffAttrs*& atrlist, GffLine& gl, bool isExon=false, bool CDSsrc=false);
    const char* getSubfName() { //returns the generic feature type of the entries in exons array
      //int sid=exon_ftype_id;
      //if (sid==gff_fid_exon && isCDS) sid=gff_fid_CDS;
@@ -870,14 +1208,14 @@ public:
    int removeExonAttr(GffExon& exon, int aid, const char* attrval=NULL);
 
    const char* getAttrName(int i) {
-     if (attrs==NULL) return NULL;
+     if (getAttrs()==NULL) return NULL;
      return names->attrs.getName(attrs->Get(i)->attr_id);
    }
 
    char* getAttr(const char* attrname, bool checkFirstExon=false) {
      if (names==NULL || attrname==NULL) return NULL;
      char* r=NULL;
-     if (attrs==NULL) {
+     if (getAttrs()==NULL) {
          if (!checkFirstExon) return NULL;
      } else
          r=attrs->getAttr(names, attrname);
@@ -899,7 +1237,7 @@ public:
       }
 
    char* getAttrValue(int i) {
-     if (attrs==NULL) return NULL;
+     if (getAttrs()==NULL) return NULL;
      return attrs->Get(i)->attr_val;
      }
    const char* getGSeqName() {
@@ -969,11 +1307,18 @@ public:
       }
 
    //---------------------
+   //order of the reference sequences of two records: by id#, or by name for the records
+   //of readers with separate dictionaries (whose id#s are unrelated)
+   int cmpGSeq(GffObj& d) {
+       if (names==d.names) return gseq_id-d.gseq_id;
+       return strcmp(getGSeqName(), d.getGSeqName());
+       }
    bool operator==(GffObj& d){
-       return (gseq_id==d.gseq_id && start==d.start && end==d.end && strcmp(gffID, d.gffID)==0);
+       return (cmpGSeq(d)==0 && start==d.start && end==d.end && strcmp(gffID, d.gffID)==0);
        }
    bool operator>(GffObj& d){
-      if (gseq_id!=d.gseq_id) return (gseq_id>d.gseq_id);
+      int c=cmpGSeq(d);
+      if (c!=0) return (c>0);
       if (start==d.start) {
          if (getLevel()==d.getLevel()) {
              if (end==d.end) return (strcmp(gffID, d.gffID)>0);
@@ -982,7 +1327,8 @@ public:
          } else return (start>d.start);
       }
    bool operator<(GffObj& d){
-     if (gseq_id!=d.gseq_id) return (gseq_id<d.gseq_id);
+     int c=cmpGSeq(d);
+     if (c!=0) return (c<0);
      if (start==d.start) {
          if (getLevel()==d.getLevel()) {
             if (end==d.end) return strcmp(gffID, d.gffID)<0;
@@ -994,13 +1340,16 @@ public:
 
    char* getGeneID() { return geneID; }
    char* getGeneName() { return gene_name; }
-   void setGeneName(const char* gname) {
-        GFREE(gene_name);
-        if (gname) gene_name=Gstrdup(gname);
-   }
-   void setGeneID(const char* gene_id) {
-        GFREE(geneID);
-        if (gene_id) geneID=Gstrdup(gene_id);
+   void setGeneName(const char* gname) { setGeneStr(gene_name, gname); }
+   void setGeneID(const char* gene_id) { setGeneStr(geneID, gene_id); }
+   void setGeneStr(char*& gstr, const char* v) {
+        if (flag_GENE_DICT) {
+           gstr=(v==NULL) ? NULL : names->genes.internName(v);
+           return;
+        }
+        if (gstr==v) return;
+        GFREE(gstr);
+        if (v!=NULL) gstr=Gstrdup(v);
    }
    int addSeg(GffLine* gfline);
    int addSeg(int fnid, GffLine* gfline);
@@ -1083,7 +1432,9 @@ class GSeqStat {
 };
 
 
-int gfo_cmpByLoc(const pointer p1, const pointer p2);
+int gfo_cmpByLoc(const pointer p1, const pointer p2); //by reference name, then location
+//by reference id# (input order), then location; the id# orders of readers with separate
+//dictionaries cannot be merged, so a list mixing their records is sorted with gfo_cmpByLoc()
 int gfo_cmpRefByID(const pointer p1, const pointer p2);
 
 class GfList: public GList<GffObj> {
@@ -1118,6 +1469,9 @@ class GfList: public GList<GffObj> {
      }
 };
 
+class GffLineBlock;
+class GffReadAhead;
+
 class CNonExon { //utility class used in subfeature promotion
  public:
    //int idx;
@@ -1125,34 +1479,123 @@ class CNonExon { //utility class used in subfeature promotion
    GffExon* exon;
    GffLine* gffline;
    //CNonExon(int i, GffObj* p, GffExon* e, GffLine* gl) {
-   CNonExon(GffObj* p, GffExon* e, GffLine& gl) {
+   bool inArena; //gffline copy was allocated in the reader's parsing arena
+   CNonExon(GffObj* p, GffExon* e, GffLine& gl, GArena* arena=NULL) {
      parent=p;
      exon=e;
      //idx=i;
-     gffline=new GffLine(gl);
+     inArena=(arena!=NULL);
+     if (inArena) gffline=new (arena->alloc(sizeof(GffLine))) GffLine(gl, arena);
+       else gffline=new GffLine(gl);
      }
   ~CNonExon() {
-     delete gffline;
+     if (inArena) gffline->~GffLine();
+       else delete gffline;
      }
  };
 
+#define GFF_IDLIST_MININDEX 8 //records sharing an ID before they are also indexed by locus
+
+//GffIdList -- the records sharing an ID (phash value); once an ID is reused by more than
+//a few records (repeats, tRNA copies etc.), the list is also indexed by genomic sequence
+//and GFF_MAX_LOCUS sized bins of record start, so gfoFind() does not scan all of them
+class GffIdList:public GPVec<GffObj> {
+ protected:
+   struct LocusBin {
+     int gseq_id;
+     int bin; //start/GFF_MAX_LOCUS when indexed
+     GVec<int> recs; //list indexes, ascending
+     LocusBin(int gid=-1, int b=0):gseq_id(gid), bin(b), recs() { }
+   };
+   GPVec<LocusBin>* bins; //sorted by gseq_id, bin
+   int nindexed; //list entries already added to bins
+   LocusBin* findBin(int gseq_id, int bin, int* ins=NULL);
+   void indexRec(int i);
+ public:
+   GffIdList():GPVec<GffObj>(false), bins(NULL), nindexed(0) { }
+   ~GffIdList() { delete bins; }
+   //a list entry was replaced by a record which could be in another bin
+   void recIndexChanged(int i) { if (bins!=NULL && i<nindexed) indexRec(i); }
+   //the start of list entry gfo was changed from ostart (e.g. by a new exon), so it may
+   //belong to another bin now
+   void recStartChanged(GffObj* gfo, uint ostart);
+   //first record on gseq_id compatible with strand and located around start (overlapping
+   //start..end if end>0), like a scan of the list would find it
+   GffObj* findLocus(int gseq_id, char strand, uint start, uint end);
+};
+
+#define GFF_PCACHE_SIZE 4
+
+//GffParentCache -- the IDs most recently added or looked up in phash, checked before it;
+//in most files the exons (or child transcripts) follow their parent closely
+struct GffParentCache {
+   struct Entry {
+     const char* id; //the phash key
+     GffIdList* lst;
+   };
+   Entry ents[GFF_PCACHE_SIZE];
+   int count;
+   int64 lookups; //ID lookups (of parents, and of new records' own IDs)
+   int64 hits; //lookups served by the cache
+   GffParentCache():count(0), lookups(0), hits(0) { }
+   GffIdList* find(const char* id) {
+     lookups++;
+     for (int i=0;i<count;i++) {
+       if (ents[i].id==id || strcmp(ents[i].id, id)==0) {
+         Entry e=ents[i];
+         for (;i>0;i--) ents[i]=ents[i-1];
+         ents[0]=e;
+         hits++;
+         return e.lst;
+       }
+     }
+     return NULL;
+   }
+   void add(const char* key, GffIdList* lst) { //key must not be in the cache
+     int i=(count<GFF_PCACHE_SIZE) ? count++ : count-1;
+     for (;i>0;i--) ents[i]=ents[i-1];
+     ents[0].id=key;
+     ents[0].lst=lst;
+   }
+   void clear() { count=0; } //phash entries were removed
+};
+
+#define GFFSNAP_EXT ".gfs" //default snapshot file name suffix
+
+//a numeric attribute column of a GffReader (see GffReader::numericAttrs())
+class GffNumColumn {
+ public:
+  char* name;
+  GVec<double> values; //by GffObj::numrow, NAN for the records without this attribute
+  GffNumColumn(const char* aname):name(Gstrdup(aname)), values(0) { }
+  ~GffNumColumn() { GFREE(name); }
+};
 
 class GffReader {
   friend class GffObj;
   friend class GffLine;
   friend class GfList;
-  char* linebuf;
-  off_t fpos;
-  int buflen;
+  GArena objarena; //if enabled by useArena(), holds all the data loaded by readAll()
+                   //(declared first so it is released after everything else)
+  GBlockLineReader linereader; //block-buffered input, lines are returned in place
+  GArena lnarena; //per-line scratch memory: the current GffLine and its parsed fields
+  GArena pexarena; //readAll() scratch memory for the copies of potential parent subfeatures
+  GffReadAhead* readahead; //readNext() pipeline, if started
+  GZReader* gzreader; //decompressor for gzip/BGZF input files
+  GffIndex* regidx; //region index, for readRegion()
+  void deleteGffLine() { //gffline is allocated in lnarena
+     if (gffline!=NULL) {
+        gffline->~GffLine();
+        gffline=NULL;
+     }
+  }
  protected:
   union {
 	unsigned int flags;
-    unsigned int gff_type: 6;
+    unsigned int gff_type: 4;
     struct {
        bool is_gff3: 1;  //GFF3 syntax was detected
        bool is_gtf:1; //GTF syntax was detected
-       bool gtf_transcript:1; //has "transcript" features (2-level GTF)
-       bool gtf_gene:1; //has "gene" features (3-level GTF ..Ensembl?)
        bool is_BED:1; //input is BED-12 format, possibly with attributes in 13th field
        bool is_TLF:1; //input is GFF3-like Transcript Line Format with exons= attribute
        //--other flags
@@ -1168,8 +1611,18 @@ class GffReader {
        bool refAlphaSort:1; //if sortByLoc, reference sequences are
                        // sorted lexically instead of their id#
        bool gff_warns:1;
+       bool use_Arena:1; //allocate all readAll() data in objarena
+       bool lazy_Attrs:1; //with keep_Attrs, keep record attributes raw until first read
+       bool attr_Filter:1; //attributes are projected through attrFilter (see filterAttrs())
+       bool attr_Exclude:1; //attrFilter lists the attributes to drop instead of those to keep
+       bool clean_Annotation:1; //input is known-good annotation (e.g. GENCODE), see cleanAnnotation()
+       bool num_Attrs:1; //some attributes are also kept as numeric columns, see numericAttrs()
     };
   };
+  bool clean_Active; //the clean annotation fast path is still in use by processGffLine()
+  //set while the records are built, so kept apart from the flags read by a readNext() pipeline thread
+  bool gtf_transcript; //has "transcript" features (2-level GTF)
+  bool gtf_gene; //has "gene" features (3-level GTF ..Ensembl?)
   //char* lastReadNext;
   FILE* fh;
   char* fname;  //optional fasta file with the underlying genomic sequence to be attached to this reader
@@ -1178,19 +1631,49 @@ class GffReader {
   BEDLine* bedline;
   //bool transcriptsOnly; //keep only transcripts w/ their exon/CDS features
   //bool gene2exon;  // for childless genes: add an exon as the entire gene span
+  GStrSet attrFilter; //attribute names given to filterAttrs()
+  GffAttrsPool attrPool; //shared exon/CDS attribute lists of the loaded records
+  GHash<int> numAttrCols; //attribute name => numeric column
+  GPVec<GffNumColumn> numCols;
+  int numRows;
+  int addNumRow(GffObj* gfo);
+  void clearNumRows(); //drop all the rows (their records are gone or handed off)
+  void noteNumAttrs(GffObj* gfo, GffLine& gl, bool exonline); //numeric values of a record's line
+  void numAttrsFromStrings(GffObj* gfo); //numeric values from the attributes kept as strings
+  void renumberNumRows(); //row i for gflst[i], the rows of the records not in gflst are dropped
   GHash<int> discarded_ids; //for transcriptsOnly mode, keep track
                             // of discarded parent IDs
-  GHash< GPVec<GffObj> > phash; //transcript_id => GPVec<GffObj>(false)
+  GHash<GffIdList> phash; //ID => records with that ID
+  GffParentCache pcache; //recently used phash entries
   //GHash<int> tids; //just for transcript_id uniqueness
   char* gfoBuildId(const char* id, const char* ctg);
   //void gfoRemove(const char* id, const char* ctg);
   GffObj* gfoAdd(GffObj* gfo);
-  GffObj* gfoAdd(GPVec<GffObj>& glst, GffObj* gfo);
-  GffObj* gfoReplace(GPVec<GffObj>& glst, GffObj* gfo, GffObj* toreplace);
+  GffObj* gfoAdd(GffIdList& glst, GffObj* gfo);
+  GffObj* gfoReplace(GffIdList& glst, GffObj* gfo, GffObj* toreplace);
   // const char* id, const char* ctg, char strand, GVec<GfoHolder>** glst, uint start, uint end
-  bool pFind(const char* id, GPVec<GffObj>*& glst);
-  GffObj* gfoFind(const char* id, GPVec<GffObj>* & glst, const char* ctg=NULL,
+  bool pFind(const char* id, GffIdList*& glst);
+  GffObj* gfoFind(const char* id, GffIdList* & glst, const char* ctg=NULL,
 	                                         char strand=0, uint start=0, uint end=0);
+  GffLine* readGffLine(); //nextGffLine() without noteGffLine()
+  void parseComment(char* l); //commentParser call, deferred to readNext() while the pipeline runs
+  void noteGffLine(GffLine* gl); //update reader flags and feature names for a new line, in input order
+  void processGffLine(GHash<CNonExon>& pex, bool& validation_errors); //readAll() step for gffline
+  //processGffLine() fast path for clean annotation; returns false, without any changes,
+  //for the lines needing the general path
+  bool processCleanGffLine(GHash<CNonExon>& pex, bool& validation_errors);
+  void readAllDone(bool validation_errors);
+  void reserveIds(); //size phash for the records expected in the input file
+  void processBEDLine(); //readAll() step for bedline
+  int64 lineVOffset(); //(virtual) file offset of the last line read
+  bool seekInput(int64 voff);
+  void updateSeqStats(GffObj* gfo); //gseqtable and gseqStats update for a finalized record
+  void clearRecords(); //release gflst and what was loaded with it, before readRegion()/loadSnapshot()
+  uint64_t snapshotOptions(); //reader options which must match for a snapshot to be used
+  void parseGffBlock(char* data, int dlen, GffLineBlock& lblock); //readAll(nthreads) worker
+  void readAheadLines(); //readNext() pipeline thread
+  GffObj* readAheadNext();
+  void stopReadAhead();
   CNonExon* subfPoolCheck(GffLine* gffline, GHash<CNonExon>& pex, char*& subp_name);
   void subfPoolAdd(GHash<CNonExon>& pex, GffObj* newgfo);
   GffObj* promoteFeature(CNonExon* subp, char*& subp_name, GHash<CNonExon>& pex);
@@ -1200,23 +1683,22 @@ class GffReader {
 #endif
  public:
   GPVec<GSeqStat> gseqtable; //table with all genomic sequences, but only current GXF gseq ID indices will have non-NULL
-  //GffNames* names; //just a pointer to the global static Gff names repository
+  GffNames* names; //dictionaries of the records created by this reader
   GfList gflst; //keeps track of all GffObj records being read (when readAll() is used)
   GffObj* newGffRec(GffLine* gffline, GffObj* parent=NULL, GffExon* pexon=NULL,
-		       GPVec<GffObj>* glst=NULL, bool replace_parent=false);
-  GffObj* newGffRec(BEDLine* bedline, GPVec<GffObj>* glst=NULL);
+		       GffIdList* glst=NULL, bool replace_parent=false);
+  GffObj* newGffRec(BEDLine* bedline, GffIdList* glst=NULL);
   //GffObj* replaceGffRec(GffLine* gffline, bool keepAttr, bool noExonAttr, int replaceidx);
   GffObj* updateGffRec(GffObj* prevgfo, GffLine* gffline);
   GffObj* updateParent(GffObj* newgfh, GffObj* parent);
   bool readExonFeature(GffObj* prevgfo, GffLine* gffline, GHash<CNonExon>* pex=NULL);
   GPVec<GSeqStat> gseqStats; //populated after finalize() with only the ref seqs in this file
-  GffReader(FILE* f=NULL, bool t_only=false, bool sort=false):linebuf(NULL), fpos(0),
-		  buflen(0), flags(0), fh(f), fname(NULL), commentParser(NULL), gffline(NULL),
-		  bedline(NULL), discarded_ids(true), phash(true), gseqtable(1,true),
+  GffReader(FILE* f=NULL, bool t_only=false, bool sort=false):objarena(GARENA_BLOCKSIZE<<4, true),
+		  linereader(f), lnarena(), pexarena(), readahead(NULL), gzreader(NULL), regidx(NULL), flags(0), clean_Active(false), gtf_transcript(false), gtf_gene(false), fh(f), fname(NULL), commentParser(NULL), gffline(NULL),
+		  bedline(NULL), numAttrCols(true), numCols(4, true), numRows(0), discarded_ids(true), phash(true), gseqtable(1,true),
 		  gflst(), gseqStats(1, false) {
-      GMALLOC(linebuf, GFF_LINELEN);
-      buflen=GFF_LINELEN-1;
-      gffnames_ref(GffObj::names);
+      names=NULL;
+      gffnames_ref(names);
       //gff_warns=gff_show_warnings;
       transcripts_Only=t_only;
       sortByLoc=sort;
@@ -1240,11 +1722,46 @@ class GffReader {
   bool getSorting() { return sortByLoc; }
   void isBED(bool v=true) { is_BED=v; } //should be set before any parsing!
   void isTLF(bool v=true) { is_TLF=v; } //should be set before any parsing!
+  //opt-in for well-formed annotation from known-good sources (e.g. GENCODE, Ensembl):
+  //the common line types are parsed and linked without the checks for quirky input,
+  //falling back to the general parsing from the first line that needs them
+  //(should be set before any parsing!)
+  void cleanAnnotation(bool v=true) { clean_Annotation=v; clean_Active=v; }
   void keepAttrs(bool keep_attrs=true, bool discardExonAttrs=true, bool preserve_exon_attrs=false) {
 	  keep_Attrs=keep_attrs;
 	  noExonAttrs=discardExonAttrs;
 	  keep_AllExonAttrs=preserve_exon_attrs;
   }
+  //with keepAttrs(), parse a record's own attributes only when they are first read
+  //(GffObj::getAttr(), getAttrs() etc.); the attribute name dictionary then only holds
+  //the names of attributes that were read. Not safe for concurrent first reads of a record.
+  void lazyAttrs(bool v=true) { lazy_Attrs=v; }
+  //with keepAttrs(), only keep the attributes named in attrlist (separated by ',', ';' or spaces),
+  //or all but those if exclude is set; the others are dropped while the lines are tokenized.
+  //NULL or an empty list keeps all attributes again.
+  void filterAttrs(const char* attrlist, bool exclude=false);
+  //also keep the values of the attributes named in attrlist (e.g. "cov,FPKM,TPM") as numbers,
+  //parsed once while reading, in one dense column per attribute with a row for each record
+  //(GffObj::numrow; readAll() and readRegion() renumber the rows so that row i is for gflst[i]).
+  //readNext() only keeps the row of the record it returned last: the values of a record it
+  //returned are available until the next readNext() call.
+  //A record takes the value on its own line, or else the first one on its exon/CDS lines.
+  //This does not need keepAttrs() and is not affected by filterAttrs(), except for BED input
+  //which takes the values from the attributes kept as strings.
+  //Must be called before reading; NULL or an empty list removes the columns.
+  void numericAttrs(const char* attrlist);
+  int numColumns() { return numCols.Count(); }
+  int numColumn(const char* attrname) { //column of a numeric attribute, or -1
+	  int* c=numAttrCols.Find(attrname);
+	  return (c==NULL) ? -1 : *c;
+  }
+  GVec<double>& numValues(int col) { return numCols[col]->values; } //NAN where missing
+  double numValue(int col, GffObj* gfo) {
+	  return (gfo->numrow<0 || gfo->numrow>=numRows) ? NAN : numCols[col]->values[gfo->numrow];
+  }
+  bool keepAttr(const char* name, int nlen) {
+	  return !attr_Filter || attrFilter.hasKeyLen(name, nlen)!=attr_Exclude;
+  }
   void transcriptsOnly(bool t_only) { transcripts_Only=t_only; }
   bool transcriptsOnly() { return transcripts_Only; }
   void setIgnoreLocus(bool nolocus) { ignoreLocus=nolocus; }
@@ -1266,40 +1783,56 @@ class GffReader {
 	refAlphaSort=v;
 	if (v) sortByLoc=true;
   }
+  //allocate all the records loaded by readAll() in a reader-owned arena, so their
+  //memory is released at once when the reader is destroyed (records marked as used
+  //are destroyed too); must be set before readAll()
+  void useArena(bool v=true) { use_Arena=v; }
   void setCommentParser(GFFCommentParser* cmParser=NULL) {
 	  commentParser=cmParser;
   }
 
-  GffReader(const char* fn, bool t_only=false, bool sort=false):linebuf(NULL), fpos(0),
-	  		  buflen(0), flags(0), fh(NULL), fname(NULL), commentParser(NULL),
-			  gffline(NULL), bedline(NULL), discarded_ids(true),
+  GffReader(const char* fn, bool t_only=false, bool sort=false):objarena(GARENA_BLOCKSIZE<<4, true),
+	  		  linereader(), lnarena(), pexarena(), readahead(NULL), gzreader(NULL), regidx(NULL), flags(0), clean_Active(false), gtf_transcript(false), gtf_gene(false), fh(NULL), fname(NULL), commentParser(NULL),
+			  gffline(NULL), bedline(NULL), numAttrCols(true), numCols(4, true), numRows(0), discarded_ids(true),
 			  phash(true), gseqtable(1,true), gflst(), gseqStats(1,false) {
       //gff_warns=gff_show_warnings;
-      gffnames_ref(GffObj::names);
+      names=NULL;
+      gffnames_ref(names);
       noExonAttrs=true;
       transcripts_Only=t_only;
       sortByLoc=sort;
       fname=Gstrdup(fn);
       fh=fopen(fname, "rb");
-      GMALLOC(linebuf, GFF_LINELEN);
-      buflen=GFF_LINELEN-1;
+      int gzfmt=(fh==NULL) ? 0 : GZReader::detect(fh);
+      if (gzfmt>0) { //gzip or BGZF compressed
+         gzreader=new GZReader(fh, gzfmt==2);
+         linereader.setSource(gzreader, GZReader::readProc);
+      }
+      else linereader.setFile(fh);
       //lastReadNext=NULL;
       }
 
  ~GffReader() {
-      delete gffline;
-      gffline=NULL;
-      fpos=0;
+      stopReadAhead();
+      deleteGffLine();
+      delete gzreader;
+      delete regidx;
       if (fh && fh!=stdin) fclose(fh);
-      gflst.freeUnused();
-      gflst.Clear();
-      discarded_ids.Clear();
-      phash.Clear();
+      clearRecords(); //no record can outlive the arena
       GFREE(fname);
-      GFREE(linebuf);
       //GFREE(lastReadNext);
-      gffnames_unref(GffObj::names);
+      gffnames_unref(names);
       }
+  //use the dictionaries of another reader (before any parsing); this is only a speed-up:
+  //records of readers with separate dictionaries are compared by name (e.g. in gfo_cmpByLoc()),
+  //while with shared dictionaries their ids are compared directly;
+  //readers sharing dictionaries should not parse concurrently
+  void setNames(GffNames* gnames) {
+      if (gnames==NULL || gnames==names) return;
+      gffnames_unref(names);
+      names=gnames;
+      gffnames_ref(names);
+  }
 
 
   GffLine* nextGffLine();
@@ -1307,6 +1840,9 @@ class GffReader {
 
   // load all subfeatures, re-group them:
   void readAll();
+  //same as readAll(), but GFF/GTF lines are parsed by nthreads threads, in blocks;
+  //records are then linked in input order so gflst is the same as with readAll()
+  void readAll(int nthreads);
   void readAll(bool keepAttr, bool mergeCloseExons=false, bool noExonAttr=true) {
 	  this->keep_Attrs=keepAttr;
 	  this->merge_CloseExons=mergeCloseExons;
@@ -1317,6 +1853,41 @@ class GffReader {
 
   //only for well-formed files: BED or GxF where exons are strictly grouped by their transcript_id/Parent
   GffObj* readNext(); //user must free the returned GffObj* !
+  //pipelined readNext(): a background thread reads and parses the input lines and groups
+  //them by transcript, staying at most maxqueue records ahead of readNext() calls
+  //(must be called before the first readNext(); only readNext() can be used afterwards)
+  void startReadAhead(int maxqueue=256);
+  bool isCompressed() { return (gzreader!=NULL); }
+  //record ID lookups while loading records (for parents and for the records' own IDs),
+  //and how many were served by the cache of recently seen IDs instead of phash
+  int64 parentLookups() { return pcache.lookups; }
+  int64 parentCacheHits() { return pcache.hits; }
+  //number of threads inflating BGZF input (0 = all cores, up to 8); set before reading
+  void setDecompThreads(int nthreads) { if (gzreader) gzreader->setThreads(nthreads); }
+
+  //region index (plain or BGZF compressed input): buildIndex() parses the whole input
+  //like readAll() and writes the index to idxfn (default: input file name + GFFIDX_EXT);
+  //returns the number of genomic sequences indexed
+  int buildIndex(const char* idxfn=NULL);
+  bool loadIndex(const char* idxfn=NULL);
+  //replaces the gflst records with the finalized records overlapping chrom:start-end,
+  //loading the default index file if needed; returns the number of records found
+  //(can be called repeatedly, but not mixed with readAll() or readNext())
+  int readRegion(const char* chrom, uint start, uint end);
+
+  //binary snapshot of the records loaded by readAll() (gflst, with their parent/child links,
+  //exons, CDS segments, kept attributes and numeric attribute values) and of the reader's
+  //names dictionaries;
+  //default file name: input file name + GFFSNAP_EXT
+  bool saveSnapshot(const char* snapfn=NULL);
+  //loads gflst from a snapshot, instead of readAll(); fails (leaving gflst empty) if the snapshot
+  //is missing, was made with other reader options (including filterAttrs() and numericAttrs()
+  //settings) or the input file has changed since (as told by its size, modification time
+  //and a sample of its content)
+  bool loadSnapshot(const char* snapfn=NULL);
+  //readAll() through a snapshot cache: a valid snapshot is loaded, otherwise a new one is saved
+  //after readAll(); returns true if the snapshot was used
+  bool readAllCached(const char* snapfn=NULL);
 
 #ifdef CUFFLINKS
     boost::crc_32_type current_crc_result() const { return _crc_result; }
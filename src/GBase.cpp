@@ -1,6 +1,13 @@
 #include "GBase.h"
 #include <ctype.h>
 #include <errno.h>
+#include <mutex>
+#include <atomic>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #ifndef S_ISDIR
 #define S_ISDIR(mode)  (((mode) & S_IFMT) == S_IFDIR)
@@ -72,18 +79,175 @@ void GMessage(const char* format,...){
   }
 
 /*************** Memory management routines *****************/
+//--- arena allocation hooks
+static thread_local GArena* arena_active=NULL;
+//the blocks of hookable arenas are made of aligned pages which are tagged in a
+//3-level page map (16 bits of the page number per level), so GFree()/GRealloc()
+//can recognize arena memory with a few lock-free loads
+struct GArenaPageLeaf {
+  std::atomic<uint64_t> bits[(1<<16)/64];
+};
+struct GArenaPageMid {
+  std::atomic<GArenaPageLeaf*> leaves[1<<16];
+};
+static std::atomic<GArenaPageMid*> arena_pagemap[1<<16];
+static std::atomic<int> arena_hooked(0); //fast check for GFree(): number of tagged blocks
+static std::mutex arena_mutex; //only for adding page map nodes
+
+static GArenaPageLeaf* arenaPageLeaf(uint64_t pn, bool create) {
+  GArenaPageMid* mid=arena_pagemap[pn>>32].load(std::memory_order_acquire);
+  if (mid==NULL) {
+    if (!create) return NULL;
+    std::lock_guard<std::mutex> lock(arena_mutex);
+    mid=arena_pagemap[pn>>32].load(std::memory_order_relaxed);
+    if (mid==NULL) {
+      mid=(GArenaPageMid*)calloc(1, sizeof(GArenaPageMid));
+      if (mid==NULL) GError(ERR_ALLOC);
+      arena_pagemap[pn>>32].store(mid, std::memory_order_release);
+    }
+  }
+  std::atomic<GArenaPageLeaf*>& lref=mid->leaves[(pn>>16) & 0xFFFF];
+  GArenaPageLeaf* leaf=lref.load(std::memory_order_acquire);
+  if (leaf==NULL && create) {
+    std::lock_guard<std::mutex> lock(arena_mutex);
+    leaf=lref.load(std::memory_order_relaxed);
+    if (leaf==NULL) {
+      leaf=(GArenaPageLeaf*)calloc(1, sizeof(GArenaPageLeaf));
+      if (leaf==NULL) GError(ERR_ALLOC);
+      lref.store(leaf, std::memory_order_release);
+    }
+  }
+  return leaf;
+}
+
+static void arenaTagPages(const char* start, size_t size, bool tag) {
+  uint64_t pn=((uintptr_t)start)>>GARENA_PAGEBITS;
+  uint64_t pend=pn+(size>>GARENA_PAGEBITS);
+  for (;pn<pend;pn++) {
+    GArenaPageLeaf* leaf=arenaPageLeaf(pn, true);
+    uint64_t bit=((uint64_t)1)<<(pn & 63);
+    if (tag) leaf->bits[(pn & 0xFFFF)>>6].fetch_or(bit, std::memory_order_release);
+    else leaf->bits[(pn & 0xFFFF)>>6].fetch_and(~bit, std::memory_order_release);
+  }
+  if (tag) arena_hooked.fetch_add(1, std::memory_order_release);
+  else arena_hooked.fetch_sub(1, std::memory_order_release);
+}
+
+bool GArena::owns(const void* p) {
+  if (arena_hooked.load(std::memory_order_acquire)==0) return false;
+  uint64_t pn=((uintptr_t)p)>>GARENA_PAGEBITS;
+  GArenaPageLeaf* leaf=arenaPageLeaf(pn, false);
+  if (leaf==NULL) return false;
+  return (leaf->bits[(pn & 0xFFFF)>>6].load(std::memory_order_acquire)>>(pn & 63)) & 1;
+}
+
+static char* arenaBlockAlloc(size_t size, bool aligned) {
+  void* p=NULL;
+  if (!aligned) p=malloc(size);
+  else {
+ #ifdef _WIN32
+    p=_aligned_malloc(size, GARENA_PAGESIZE);
+ #else
+    if (posix_memalign(&p, GARENA_PAGESIZE, size)!=0) p=NULL;
+ #endif
+  }
+  if (p==NULL) GError(ERR_ALLOC);
+  return (char*)p;
+}
+
+static void arenaBlockFree(char* p, bool aligned) {
+ #ifdef _WIN32
+  if (aligned) { _aligned_free(p); return; }
+ #endif
+  free(p);
+}
+
+GArena* GArena::activate(GArena* a) {
+  if (a!=NULL && !a->hookable)
+    GError("Error: GArena::activate() requires a hookable arena!\n");
+  GArena* prev=arena_active;
+  arena_active=a;
+  return prev;
+}
+
+GArena* GArena::active() { return arena_active; }
+
+void* GArena::newBlock(size_t size) {
+  //large allocations get their own block, the current block is still used after that
+  bool single=(size>(blocksize>>2));
+  size_t bsize=single ? size : blocksize;
+  if (hookable) //whole pages, so they can be tagged
+    bsize=(bsize+GARENA_PAGESIZE-1) & ~((size_t)GARENA_PAGESIZE-1);
+  char* data=arenaBlockAlloc(bsize, hookable);
+  if (nblocks==capblocks) {
+    capblocks=(capblocks==0) ? 8 : capblocks<<1;
+    blocks=(GArenaBlock*)realloc(blocks, capblocks*sizeof(GArenaBlock));
+    if (blocks==NULL) GError(ERR_ALLOC);
+  }
+  blocks[nblocks].data=data;
+  blocks[nblocks].size=bsize;
+  nblocks++;
+  if (hookable) arenaTagPages(data, bsize, true);
+  if (single && nblocks>1) return data;
+  cur=data+size;
+  cend=data+bsize;
+  return data;
+}
+
+void* GArena::hookAlloc(size_t size) {
+  size_t* p=(size_t*)alloc(size+2*sizeof(size_t));
+  p[0]=size;
+  return (void*)(p+2);
+}
+
+void GArena::reset() {
+  if (nblocks==0) return;
+  for (int i=1;i<nblocks;i++) {
+    if (hookable) arenaTagPages(blocks[i].data, blocks[i].size, false);
+    arenaBlockFree(blocks[i].data, hookable);
+  }
+  nblocks=1;
+  cur=blocks[0].data;
+  cend=cur+blocks[0].size;
+}
+
+void GArena::clear() {
+  for (int i=0;i<nblocks;i++) {
+    if (hookable) arenaTagPages(blocks[i].data, blocks[i].size, false);
+    arenaBlockFree(blocks[i].data, hookable);
+  }
+  free(blocks);
+  blocks=NULL;
+  nblocks=0;
+  capblocks=0;
+  cur=NULL;
+  cend=NULL;
+}
+
+size_t GArena::capacity() {
+  size_t r=0;
+  for (int i=0;i<nblocks;i++) r+=blocks[i].size;
+  return r;
+}
+
 // Allocate memory
 bool GMalloc(pointer* ptr,unsigned long size){
   //GASSERT(ptr);
-  if (size!=0)
-	  *ptr=malloc(size);
+  if (size!=0) {
+	  if (arena_active) *ptr=arena_active->hookAlloc(size);
+	  else *ptr=malloc(size);
+  }
   return *ptr!=NULL;
   }
 
 // Allocate cleaned memory (0 filled)
 bool GCalloc(pointer* ptr,unsigned long size){
   GASSERT(ptr);
-  *ptr=calloc(size,1);
+  if (arena_active) {
+    *ptr=arena_active->hookAlloc(size);
+    memset(*ptr, 0, size);
+  }
+  else *ptr=calloc(size,1);
   return *ptr!=NULL;
   }
 
@@ -95,13 +259,22 @@ bool GRealloc(pointer* ptr,unsigned long size){
     return true;
     }
   if (*ptr==NULL) {//simple malloc
-   void *p=malloc(size);
+   void *p=arena_active ? arena_active->hookAlloc(size) : malloc(size);
    if (p != NULL) {
      *ptr=p;
      return true;
      }
     else return false;
    }//malloc
+  else if (GArena::owns(*ptr)) { //arena memory cannot grow in place
+   size_t osize=GArena::allocSize(*ptr);
+   if (size<=osize) return true;
+   void *p=arena_active ? arena_active->hookAlloc(size) : malloc(size);
+   if (p==NULL) return false;
+   memcpy(p, *ptr, osize);
+   *ptr=p;
+   return true;
+   }
   else {//realloc
    void *p=realloc(*ptr,size);
    if (p) {
@@ -114,7 +287,7 @@ bool GRealloc(pointer* ptr,unsigned long size){
 // Free memory, resets ptr to NULL afterward
 void GFree(pointer* ptr){
   GASSERT(ptr);
-  if (*ptr) free(*ptr);
+  if (*ptr && !GArena::owns(*ptr)) free(*ptr);
   *ptr=NULL;
   }
 
@@ -451,6 +624,95 @@ char* GLineReader::getLine(FILE* stream, off_t& f_pos) {
    return buf();
 }
 
+void GBlockLineReader::fillBuf() {
+  if (bstart>0) { //move the partial line to the beginning of buf
+    if (bend>bstart) memmove(buf, buf+bstart, bend-bstart);
+    bend-=bstart;
+    bstart=0;
+  }
+  if (bend>=bufcap-1) { //a line longer than the whole buffer
+    bufcap=((bufcap-1)<<1)+1;
+    GREALLOC(buf, bufcap);
+  }
+  size_t toread=bufcap-1-bend;
+  size_t r=(readProc!=NULL) ? readProc(readSrc, buf+bend, toread) :
+                              fread(buf+bend, 1, toread, file);
+  bend+=r;
+  if (r<toread) isEOF=true;
+}
+
+char* GBlockLineReader::getLine(int* linelen) {
+  if (file==NULL && readProc==NULL) return NULL;
+  int scanpos=bstart; //where to resume looking for the line ending
+  while (true) {
+    char* p=buf+scanpos;
+    int rlen=bend-scanpos;
+    char* eol=(char*)memchr(p, '\n', rlen);
+    char* cr=(char*)memchr(p, '\r', (eol==NULL) ? rlen : eol-p);
+    int eollen=1;
+    if (cr!=NULL) {
+      if (cr+1==buf+bend && !isEOF) {
+        //can't tell yet if this is a \r\n line ending
+        int s=bstart;
+        scanpos=cr-buf;
+        fillBuf();
+        scanpos-=s;
+        continue;
+      }
+      eol=cr;
+      if (cr+1<buf+bend && cr[1]=='\n') eollen=2;
+    }
+    else if (eol==NULL) {
+      if (!isEOF) {
+        int s=bstart;
+        scanpos=bend;
+        fillBuf();
+        scanpos-=s;
+        continue;
+      }
+      if (bstart==bend) { textlen=0; if (linelen) *linelen=0; return NULL; }
+      //last line without a line ending
+      eol=buf+bend;
+      eollen=0;
+    }
+    char* line=buf+bstart;
+    textlen=eol-line;
+    *eol='\0';
+    bstart+=textlen+eollen;
+    linepos=filepos;
+    filepos+=textlen+eollen;
+    lcount++;
+    if (linelen) *linelen=textlen;
+    return line;
+  }
+}
+
+char* GBlockLineReader::getLines(int& blen, int minlen) {
+  blen=0;
+  if (file==NULL && readProc==NULL) return NULL;
+  int minread=minlen;
+  char* e=NULL;
+  while (true) {
+    while (!isEOF && bend-bstart<=minread) fillBuf();
+    e=buf+bend;
+    if (isEOF) break;
+    //end the block after the last line ending; a \r as the very last byte
+    //could be the first half of a \r\n line ending
+    if (e[-1]!='\n') {
+      e--;
+      while (e>buf+bstart && e[-1]!='\n' && e[-1]!='\r') e--;
+    }
+    if (e>buf+bstart) break;
+    minread=bend-bstart; //not even one complete line yet
+  }
+  if (bstart==bend) return NULL;
+  buf[bend]='\0'; //in case the last line has no line ending
+  char* r=buf+bstart;
+  blen=e-r;
+  bstart+=blen;
+  filepos+=blen;
+  return r;
+}
 
 //strchr but with a set of chars instead of only one
 char* strchrs(const char* s, const char* chrs) {
@@ -857,6 +1119,49 @@ bool parseUInt(char* &p, uint& i) { //pointer p is advanced after the number
  return true;
 }
 
+int splitTabs(char* s, int slen, char** fields, int maxfields) {
+	int nf=1;
+	fields[0]=s;
+	if (maxfields<2) return nf;
+	int i=0;
+#if defined(__AVX2__)
+	const __m256i vtab=_mm256_set1_epi8('\t');
+	for (;i+32<=slen;i+=32) {
+		uint m=(uint)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+				_mm256_loadu_si256((const __m256i*)(s+i)), vtab));
+		while (m) {
+			int k=i+__builtin_ctz(m);
+			s[k]=0;
+			fields[nf++]=s+k+1;
+			if (nf==maxfields) return nf;
+			m&=m-1;
+		}
+	}
+#elif defined(__SSE2__)
+	const __m128i vtab=_mm_set1_epi8('\t');
+	for (;i+16<=slen;i+=16) {
+		uint m=(uint)_mm_movemask_epi8(_mm_cmpeq_epi8(
+				_mm_loadu_si128((const __m128i*)(s+i)), vtab));
+		while (m) {
+			int k=i+__builtin_ctz(m);
+			s[k]=0;
+			fields[nf++]=s+k+1;
+			if (nf==maxfields) return nf;
+			m&=m-1;
+		}
+	}
+#endif
+	while (i<slen) {
+		char* t=(char*)memchr(s+i, '\t', slen-i);
+		if (t==NULL) break;
+		*t=0;
+		fields[nf++]=t+1;
+		if (nf==maxfields) break;
+		i=t-s+1;
+	}
+	return nf;
+}
+
 bool parseHex(char* &p, uint& i) {
  //skip initial spaces/prefix
  while (*p==' ' || *p=='\t' || *p=='0' || *p=='x') p++;
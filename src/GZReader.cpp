@@ -0,0 +1,277 @@
+/*
+ * GZReader.cpp
+ *
+ *  transparent reading of gzip and BGZF compressed input
+ */
+
+#include "GZReader.h"
+#include <zlib.h>
+#include <vector>
+#include <functional>
+
+#define GZ_INBUFSIZE 262144
+#define BGZF_HDRSIZE 18 //gzip header with the BC extra subfield
+#define BGZF_MAXBLOCK 65536
+#define BGZF_BATCHBLOCKS 32 //blocks per batch and per thread
+
+static inline uint16_t gz_u16(const uchar* p) { return p[0] | (p[1]<<8); }
+static inline uint32_t gz_u32(const uchar* p) {
+	return p[0] | (p[1]<<8) | (p[2]<<16) | ((uint32_t)p[3]<<24);
+}
+
+//parses a gzip member header in h (hlen bytes): returns the BSIZE value if this
+//is a BGZF block, 0 if it's a plain gzip header, -1 if it's not gzip at all
+static int gz_bsize(const uchar* h, int hlen) {
+	if (hlen<12 || h[0]!=0x1f || h[1]!=0x8b || h[2]!=Z_DEFLATED) return -1;
+	if ((h[3] & 4)==0) return 0; //no FEXTRA
+	int xlen=gz_u16(h+10);
+	const uchar* x=h+12;
+	const uchar* xend=x+xlen;
+	if (xend>h+hlen) xend=h+hlen;
+	while (x+4<=xend) {
+		int slen=gz_u16(x+2);
+		if (x[0]=='B' && x[1]=='C' && slen==2 && x+6<=xend)
+			return gz_u16(x+4)+1;
+		x+=4+slen;
+	}
+	return 0;
+}
+
+int GZReader::detect(FILE* f) {
+	uchar h[64];
+	off_t fpos=ftello(f);
+	int hlen=fread(h, 1, 64, f);
+	fseeko(f, fpos, SEEK_SET);
+	int r=gz_bsize(h, hlen);
+	if (r<0) return 0;
+	return (r>0) ? 2 : 1;
+}
+
+GZReader::GZReader(FILE* f, bool isBGZF, int threads):file(f), bgzf(isBGZF),
+		nthreads(1), zs(NULL), inbuf(NULL), zdone(false), batches(), bcur(0),
+		started(false), prefetch(), maxblocks(BGZF_BATCHBLOCKS), cpos(0), utotal(0),
+		blockmap(), bmcur(0), skipbytes(0) {
+	setThreads(threads);
+	if (!bgzf) {
+		GArenaScope noarena(NULL);
+		zs=new z_stream;
+		memset(zs, 0, sizeof(z_stream));
+		if (inflateInit2(zs, 15+32)!=Z_OK) //gzip header expected
+			GError("Error: zlib inflateInit2() failed!\n");
+		GMALLOC(inbuf, GZ_INBUFSIZE);
+	}
+}
+
+GZReader::~GZReader() {
+	if (prefetch.joinable()) prefetch.join();
+	if (zs!=NULL) {
+		inflateEnd(zs);
+		delete zs;
+	}
+	GFREE(inbuf);
+}
+
+void GZReader::setThreads(int threads) {
+	if (started) return;
+	if (threads<=0) {
+		threads=std::thread::hardware_concurrency();
+		if (threads>8) threads=8;
+	}
+	nthreads=(threads<1) ? 1 : threads;
+	maxblocks=BGZF_BATCHBLOCKS*nthreads;
+}
+
+size_t GZReader::read(char* buf, size_t len) {
+	GArenaScope noarena(NULL); //our buffers are not part of any arena
+	return bgzf ? readBgzf(buf, len) : readGz(buf, len);
+}
+
+size_t GZReader::readGz(char* buf, size_t len) {
+	started=true;
+	size_t r=0;
+	while (r<len && !zdone) {
+		if (zs->avail_in==0) {
+			zs->avail_in=fread(inbuf, 1, GZ_INBUFSIZE, file);
+			zs->next_in=(Bytef*)inbuf;
+			if (zs->avail_in==0) {
+				zdone=true;
+				break;
+			}
+		}
+		zs->next_out=(Bytef*)(buf+r);
+		zs->avail_out=len-r;
+		int ret=inflate(zs, Z_NO_FLUSH);
+		r=len-zs->avail_out;
+		if (ret==Z_STREAM_END) {
+			//another gzip member may follow
+			if (zs->avail_in==0) {
+				zs->avail_in=fread(inbuf, 1, GZ_INBUFSIZE, file);
+				zs->next_in=(Bytef*)inbuf;
+			}
+			if (zs->avail_in==0) zdone=true;
+			else inflateReset(zs);
+		}
+		else if (ret!=Z_OK && ret!=Z_BUF_ERROR)
+			GError("Error decompressing gzip data (zlib error %d)!\n", ret);
+		else if (ret==Z_BUF_ERROR && zs->avail_in==0 && feof(file))
+			GError("Error: truncated gzip input!\n");
+	}
+	return r;
+}
+
+bool GZReader::readBlocks(GZBatch& b) {
+	b.clen=0; b.ulen=0; b.upos=0;
+	b.eof=false; //the batch may be refilled after a seek()
+	b.cstart=cpos;
+	b.boffs.Reset(); b.uoffs.Reset();
+	int nb=0;
+	while (nb<maxblocks) {
+		if (b.clen+BGZF_MAXBLOCK>b.ccap) {
+			b.ccap=b.clen+BGZF_MAXBLOCK;
+			GREALLOC(b.cdata, b.ccap);
+		}
+		uchar* h=(uchar*)(b.cdata+b.clen);
+		size_t hr=fread(h, 1, BGZF_HDRSIZE, file);
+		if (hr==0) { b.eof=true; break; }
+		int bsize=(hr==BGZF_HDRSIZE) ? gz_bsize(h, hr) : -1;
+		if (bsize<=0) GError("Error: invalid BGZF block header!\n");
+		if (bsize<BGZF_HDRSIZE+8 || fread(h+BGZF_HDRSIZE, 1, bsize-BGZF_HDRSIZE, file)
+				!=(size_t)(bsize-BGZF_HDRSIZE))
+			GError("Error: truncated BGZF block!\n");
+		b.boffs.Add((uint32_t)b.clen);
+		b.clen+=bsize;
+		cpos+=bsize;
+		nb++;
+	}
+	if (nb==0) return false;
+	b.boffs.Add((uint32_t)b.clen);
+	size_t ulen=0; //the inflated size of each block is stored in its last 4 bytes
+	for (int i=0;i<nb;i++) {
+		b.uoffs.Add(ulen);
+		ulen+=gz_u32((uchar*)b.cdata+b.boffs[i+1]-4);
+	}
+	b.uoffs.Add(ulen);
+	if (ulen>=b.ucap) { //never empty, even if the batch has only the EOF block
+		b.ucap=ulen+1;
+		GREALLOC(b.udata, b.ucap);
+	}
+	b.ulen=ulen;
+	return true;
+}
+
+static void bgzf_inflate(GZBatch* b, int bfrom, int bto) {
+	z_stream zs;
+	memset(&zs, 0, sizeof(z_stream));
+	if (inflateInit2(&zs, -15)!=Z_OK) //raw deflate data
+		GError("Error: zlib inflateInit2() failed!\n");
+	for (int i=bfrom;i<bto;i++) {
+		uchar* bd=(uchar*)b->cdata+b->boffs[i];
+		size_t bsize=b->boffs[i+1]-b->boffs[i];
+		int hlen=12+gz_u16(bd+10);
+		uInt isize=b->uoffs[i+1]-b->uoffs[i];
+		Bytef* out=(Bytef*)b->udata+b->uoffs[i];
+		inflateReset(&zs);
+		zs.next_in=bd+hlen;
+		zs.avail_in=bsize-hlen-8;
+		zs.next_out=out;
+		zs.avail_out=isize;
+		int ret=inflate(&zs, Z_FINISH);
+		if (ret!=Z_STREAM_END || zs.avail_out!=0)
+			GError("Error decompressing BGZF block (zlib error %d)!\n", ret);
+		if (crc32(crc32(0L, Z_NULL, 0), out, isize)!=gz_u32(bd+bsize-8))
+			GError("Error: BGZF block CRC mismatch!\n");
+	}
+	inflateEnd(&zs);
+}
+
+void GZReader::inflateBatch(GZBatch& b) {
+	int nb=b.boffs.Count()-1;
+	int nt=GMIN(nthreads, nb);
+	if (nt<=1) {
+		bgzf_inflate(&b, 0, nb);
+		return;
+	}
+	std::vector<std::thread> workers;
+	int bstart=0;
+	for (int t=0;t<nt;t++) {
+		int bend=(int)(((int64_t)nb*(t+1))/nt);
+		if (t<nt-1) workers.push_back(std::thread(bgzf_inflate, &b, bstart, bend));
+		else bgzf_inflate(&b, bstart, bend);
+		bstart=bend;
+	}
+	for (size_t t=0;t<workers.size();t++) workers[t].join();
+}
+
+void GZReader::useBatch(int bidx) {
+	bcur=bidx;
+	GZBatch& b=batches[bcur];
+	for (uint i=0;i+1<b.boffs.Count();i++) {
+		GZBlockPos bp={utotal+(int64)b.uoffs[i], b.cstart+b.boffs[i]};
+		blockmap.Add(bp);
+	}
+	utotal+=b.ulen;
+}
+
+size_t GZReader::readBgzf(char* buf, size_t len) {
+	if (!started) {
+		started=true;
+		fillBatch(batches[0]);
+		useBatch(0);
+		batches[0].upos=GMIN((size_t)skipbytes, batches[0].ulen);
+		if (!batches[0].eof && nthreads>1)
+			prefetch=std::thread(&GZReader::fillBatch, this, std::ref(batches[1]));
+	}
+	size_t r=0;
+	while (r<len) {
+		GZBatch& b=batches[bcur];
+		if (b.upos<b.ulen) {
+			size_t n=GMIN(len-r, b.ulen-b.upos);
+			memcpy(buf+r, b.udata+b.upos, n);
+			b.upos+=n;
+			r+=n;
+			continue;
+		}
+		if (b.eof) break;
+		//switch to the next batch
+		GZBatch& nb=batches[1-bcur];
+		if (prefetch.joinable()) prefetch.join();
+		else fillBatch(nb);
+		useBatch(1-bcur);
+		if (!nb.eof && nthreads>1)
+			prefetch=std::thread(&GZReader::fillBatch, this, std::ref(batches[1-bcur]));
+	}
+	return r;
+}
+
+bool GZReader::seek(int64 voff) {
+	if (!bgzf) { //plain gzip can only be rewound
+		if (voff!=0 || fseeko(file, 0, SEEK_SET)!=0) return false;
+		inflateReset(zs);
+		zs->avail_in=0;
+		zdone=false;
+		return true;
+	}
+	if (prefetch.joinable()) prefetch.join();
+	cpos=voff>>16;
+	if (fseeko(file, cpos, SEEK_SET)!=0) return false;
+	for (int i=0;i<2;i++) {
+		batches[i].ulen=0; batches[i].upos=0;
+		batches[i].eof=false;
+	}
+	bcur=0;
+	started=false;
+	utotal=0;
+	blockmap.Reset();
+	bmcur=0;
+	skipbytes=(int)(voff & 0xFFFF);
+	return true;
+}
+
+int64 GZReader::voffset(int64 upos) {
+	if (blockmap.Count()==0) return (cpos<<16)|(upos & 0xFFFF);
+	//calls are usually made with increasing upos values
+	if (bmcur>=(int)blockmap.Count() || blockmap[bmcur].upos>upos) bmcur=0;
+	int n=blockmap.Count();
+	while (bmcur+1<n && blockmap[bmcur+1].upos<=upos) bmcur++;
+	return (blockmap[bmcur].coffset<<16)|(upos-blockmap[bmcur].upos);
+}
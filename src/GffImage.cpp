@@ -0,0 +1,378 @@
+/*
+ * GffImage.cpp
+ *
+ *  read-only columnar annotation image, used in place through mmap()
+ */
+
+#include "GffImage.h"
+#include "gff.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define GFFIMG_ALIGN(x) (((x)+7) & ~((uint64_t)7))
+
+static int gimg_cmpRec(const pointer p1, const pointer p2) {
+	GffObj* a=(GffObj*)p1;
+	GffObj* b=(GffObj*)p2;
+	int r=strcmp(a->getGSeqName(), b->getGSeqName());
+	if (r!=0) return r;
+	if (a->start!=b->start) return (a->start<b->start) ? -1 : 1;
+	if (a->end!=b->end) return (a->end<b->end) ? -1 : 1;
+	return 0;
+}
+
+//string heap with deduplication
+class GImgStrHeap {
+	GHash<int> offsets;
+ public:
+	GDynArray<char> heap;
+	GImgStrHeap():offsets(true), heap(1<<20) { }
+	uint32_t add(const char* s) {
+		if (s==NULL) return GFFIMG_NONE;
+		int* o=offsets.Find(s);
+		if (o!=NULL) return *o;
+		uint32_t r=heap.Count();
+		heap.append((char*)s, strlen(s)+1);
+		offsets.Add(s, new int(r));
+		return r;
+	}
+};
+
+static void gimg_putVarint(GDynArray<uchar>& buf, uint v) {
+	while (v>=0x80) {
+		buf.Add((uchar)(v | 0x80));
+		v>>=7;
+	}
+	buf.Add((uchar)v);
+}
+
+//returns NULL if the varint is not complete before pend
+static inline const uchar* gimg_getVarint(const uchar* p, const uchar* pend, uint& v) {
+	v=0;
+	int shift=0;
+	while (p<pend && (*p & 0x80)) {
+		if (shift<32) v|=(uint)(*p & 0x7F)<<shift;
+		shift+=7;
+		p++;
+	}
+	if (p>=pend) return NULL;
+	if (shift<32) v|=(uint)(*p)<<shift;
+	return p+1;
+}
+
+static bool gimg_write(FILE* f, uint64_t& fpos, const void* p, size_t n) {
+	static const char zeros[8]={0,0,0,0,0,0,0,0};
+	if (n>0 && fwrite(p, 1, n, f)!=n) return false;
+	fpos+=n;
+	size_t pad=GFFIMG_ALIGN(fpos)-fpos;
+	if (pad>0 && fwrite(zeros, 1, pad, f)!=pad) return false;
+	fpos+=pad;
+	return true;
+}
+
+bool GffImage::build(const char* fname, GfList& gflst) {
+	int n=gflst.Count();
+	GPVec<GffObj> recs(n>0 ? n : 1, false);
+	for (int i=0;i<n;i++) recs.Add(gflst[i]);
+	recs.Sort(gimg_cmpRec);
+	//record indexes are kept in udata for the parent links
+	GVec<int> udata(n>0 ? n : 1);
+	for (int i=0;i<n;i++) {
+		udata.cAdd(recs[i]->udata);
+		recs[i]->udata=i;
+	}
+	GImgStrHeap strs;
+	GDynArray<GffImgSeq> seqtab;
+	size_t ncols=(size_t)n*GFFIMG_NUMCOLS;
+	uint32_t* cols=NULL;
+	GMALLOC(cols, ncols*sizeof(uint32_t)+1);
+	GDynArray<char> strands(n+1);
+	GDynArray<uchar> exondata(n*8+1);
+	//attribute name => attribute column (by name, as the records could come from
+	//readers with different dictionaries)
+	GHash<int> attrcol(true);
+	GDynArray<uint32_t> attrnames; //attribute column => name in the string heap
+	for (int i=0;i<n;i++) {
+		GffObj* gfo=recs[i];
+		if (seqtab.Count()==0 || strcmp(gfo->getGSeqName(), strs.heap()+seqtab[seqtab.Count()-1].name)!=0) {
+			GffImgSeq sq={strs.add(gfo->getGSeqName()), (uint32_t)i, 0, 0};
+			seqtab.Add(sq);
+		}
+		GffImgSeq& sq=seqtab[seqtab.Count()-1];
+		sq.count++;
+		if (gfo->len()>sq.maxspan) sq.maxspan=gfo->len();
+		uint32_t* rc=cols;
+		rc[gimgStart*n+i]=gfo->start;
+		rc[gimgEnd*n+i]=gfo->end;
+		rc[gimgCDStart*n+i]=gfo->CDstart;
+		rc[gimgCDEnd*n+i]=gfo->CDend;
+		rc[gimgSeq*n+i]=seqtab.Count()-1;
+		rc[gimgID*n+i]=strs.add(gfo->getID());
+		rc[gimgGeneID*n+i]=strs.add(gfo->getGeneID());
+		rc[gimgGeneName*n+i]=strs.add(gfo->getGeneName());
+		rc[gimgFeature*n+i]=strs.add(gfo->ftype_id>=0 ? gfo->getFeatureName() : NULL);
+		bool plink=(gfo->parent!=NULL && gfo->parent->udata>=0 && gfo->parent->udata<n &&
+				recs[gfo->parent->udata]==gfo->parent);
+		rc[gimgParent*n+i]=plink ? (uint32_t)gfo->parent->udata : GFFIMG_NONE;
+		rc[gimgExonOfs*n+i]=exondata.Count();
+		rc[gimgExonCount*n+i]=gfo->exons.Count();
+		strands.Add(gfo->strand);
+		uint prev=gfo->start;
+		for (int e=0;e<gfo->exons.Count();e++) {
+			GffExon* ex=gfo->exons[e];
+			gimg_putVarint(exondata, ex->start-prev);
+			gimg_putVarint(exondata, ex->end-ex->start);
+			prev=ex->end;
+		}
+		if (gfo->getAttrs()!=NULL) {
+			for (int a=0;a<gfo->attrs->Count();a++) {
+				const char* aname=gfo->getAttrName(a);
+				if (attrcol.Find(aname)==NULL) {
+					attrcol.Add(aname, new int(attrnames.Count()));
+					attrnames.Add(strs.add(aname));
+				}
+			}
+		}
+	}
+	int na=attrnames.Count();
+	size_t nacols=(size_t)na*n;
+	uint32_t* attrcols=NULL;
+	GMALLOC(attrcols, nacols*sizeof(uint32_t)+1);
+	for (size_t k=0;k<nacols;k++) attrcols[k]=GFFIMG_NONE;
+	for (int i=0;i<n;i++) {
+		GffAttrs* attrs=recs[i]->getAttrs();
+		if (attrs==NULL) continue;
+		for (int a=0;a<attrs->Count();a++) {
+			GffAttr* attr=attrs->Get(a);
+			int acol=*(attrcol.Find(recs[i]->getAttrName(a)));
+			uint32_t& v=attrcols[(size_t)acol*n+i];
+			if (v==GFFIMG_NONE) v=strs.add(attr->attr_val);
+		}
+	}
+	for (int i=0;i<n;i++) recs[i]->udata=udata[i];
+	//the heap must end with a NUL (see validate()), even for an empty list
+	if (strs.heap.Count()==0) strs.heap.append((char*)"", 1);
+	//write the sections
+	GffImgHeader hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	strcpy(hdr.magic, GFFIMG_MAGIC);
+	hdr.nrecs=n;
+	hdr.nseqs=seqtab.Count();
+	hdr.nattrs=na;
+	uint64_t fpos=GFFIMG_ALIGN(sizeof(hdr));
+	hdr.seqtab=fpos; fpos=GFFIMG_ALIGN(fpos+sizeof(GffImgSeq)*hdr.nseqs);
+	hdr.reccols=fpos; fpos=GFFIMG_ALIGN(fpos+sizeof(uint32_t)*ncols);
+	hdr.strands=fpos; fpos=GFFIMG_ALIGN(fpos+strands.Count());
+	hdr.exondata=fpos; fpos=GFFIMG_ALIGN(fpos+exondata.Count());
+	hdr.attrnames=fpos; fpos=GFFIMG_ALIGN(fpos+sizeof(uint32_t)*na);
+	hdr.attrcols=fpos; fpos=GFFIMG_ALIGN(fpos+sizeof(uint32_t)*nacols);
+	hdr.strheap=fpos; fpos=GFFIMG_ALIGN(fpos+strs.heap.Count());
+	hdr.fsize=fpos;
+	FILE* f=fopen(fname, "wb");
+	if (f==NULL) {
+		GFREE(cols);
+		GFREE(attrcols);
+		return false;
+	}
+	fpos=0;
+	bool ok=gimg_write(f, fpos, &hdr, sizeof(hdr)) &&
+		gimg_write(f, fpos, seqtab(), sizeof(GffImgSeq)*seqtab.Count()) &&
+		gimg_write(f, fpos, cols, sizeof(uint32_t)*ncols) &&
+		gimg_write(f, fpos, strands(), strands.Count()) &&
+		gimg_write(f, fpos, exondata(), exondata.Count()) &&
+		gimg_write(f, fpos, attrnames(), sizeof(uint32_t)*na) &&
+		gimg_write(f, fpos, attrcols, sizeof(uint32_t)*nacols) &&
+		gimg_write(f, fpos, strs.heap(), strs.heap.Count());
+	if (fclose(f)!=0) ok=false;
+	GFREE(cols);
+	GFREE(attrcols);
+	return (ok && fpos==hdr.fsize);
+}
+
+bool GffImage::open(const char* fname) {
+	close();
+#ifdef _WIN32
+	//no mmap() here, the image is just loaded
+	FILE* f=fopen(fname, "rb");
+	if (f==NULL) return false;
+	int64 fsize=fileSize(fname);
+	if (fsize<(int64)sizeof(GffImgHeader)) { fclose(f); return false; }
+	GMALLOC(data, fsize);
+	dsize=fread(data, 1, fsize, f);
+	fclose(f);
+	mapped=false;
+#else
+	int fd=::open(fname, O_RDONLY);
+	if (fd<0) return false;
+	struct stat st;
+	if (fstat(fd, &st)!=0 || st.st_size<(off_t)sizeof(GffImgHeader)) {
+		::close(fd);
+		return false;
+	}
+	void* p=mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (p==MAP_FAILED) return false;
+	data=(char*)p;
+	dsize=st.st_size;
+	mapped=true;
+#endif
+	if (!validate()) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+//a section of n items of esize bytes at ofs, aligned and following the previous
+//section (which ended at pos), within the image
+static bool gimg_section(uint64_t ofs, uint64_t n, uint64_t esize, uint64_t& pos, uint64_t dsize) {
+	if ((ofs & 7)!=0 || ofs<pos || ofs>dsize) return false;
+	if (n>0 && esize>(dsize-ofs)/n) return false;
+	pos=ofs+n*esize;
+	return true;
+}
+
+bool GffImage::validate() {
+	if (dsize<sizeof(GffImgHeader)) return false;
+	const GffImgHeader* h=(const GffImgHeader*)data;
+	if (memcmp(h->magic, GFFIMG_MAGIC, sizeof(h->magic))!=0 || h->fsize!=dsize) return false;
+	uint64_t nr=h->nrecs, na=h->nattrs;
+	if (na>0 && nr>dsize/na) return false;
+	uint64_t pos=sizeof(GffImgHeader);
+	if (!(gimg_section(h->seqtab, h->nseqs, sizeof(GffImgSeq), pos, dsize) &&
+			gimg_section(h->reccols, nr, GFFIMG_NUMCOLS*sizeof(uint32_t), pos, dsize) &&
+			gimg_section(h->strands, nr, 1, pos, dsize) &&
+			gimg_section(h->exondata, 0, 1, pos, dsize) &&
+			gimg_section(h->attrnames, na, sizeof(uint32_t), pos, dsize) &&
+			gimg_section(h->attrcols, na*nr, sizeof(uint32_t), pos, dsize) &&
+			gimg_section(h->strheap, 0, 1, pos, dsize)))
+		return false;
+	//the heap (and its padding) must end with a NUL, so any offset in it is a string
+	if (h->strheap>=dsize || data[dsize-1]!=0) return false;
+	hdr=h;
+	seqs=(const GffImgSeq*)(data+hdr->seqtab);
+	cols=(const uint32_t*)(data+hdr->reccols);
+	strands=data+hdr->strands;
+	exondata=(const uchar*)(data+hdr->exondata);
+	exlen=hdr->attrnames-hdr->exondata;
+	attrnames=(const uint32_t*)(data+hdr->attrnames);
+	attrcols=(const uint32_t*)(data+hdr->attrcols);
+	strheap=data+hdr->strheap;
+	heaplen=dsize-hdr->strheap;
+	for (uint s=0;s<hdr->nseqs;s++) {
+		const GffImgSeq& sq=seqs[s];
+		if (sq.name>=heaplen || sq.first>nr || sq.count>nr-sq.first) return false;
+	}
+	attrids=new GHash<int>(true);
+	for (uint a=0;a<hdr->nattrs;a++) {
+		if (attrnames[a]>=heaplen) return false;
+		attrids->shkAdd(strheap+attrnames[a], new int(a));
+	}
+	return true;
+}
+
+void GffImage::close() {
+	if (data!=NULL) {
+#ifndef _WIN32
+		if (mapped) munmap(data, dsize);
+		else
+#endif
+		GFREE(data);
+	}
+	data=NULL;
+	dsize=0;
+	hdr=NULL;
+	exlen=0;
+	heaplen=0;
+	delete attrids;
+	attrids=NULL;
+}
+
+int GffImage::seqIndex(const char* gseq) const { //seqs are sorted by name
+	int l=0, r=seqCount()-1;
+	while (l<=r) {
+		int m=(l+r)>>1;
+		int c=strcmp(strheap+seqs[m].name, gseq);
+		if (c==0) return m;
+		if (c<0) l=m+1;
+		else r=m-1;
+	}
+	return -1;
+}
+
+int GffImage::attrIndex(const char* attrname) const {
+	if (attrids==NULL) return -1;
+	int* a=attrids->Find(attrname);
+	return (a==NULL) ? -1 : *a;
+}
+
+int GffImage::findOverlaps(const char* gseq, uint start, uint end, GVec<int>& idxs) const {
+	int s=seqIndex(gseq);
+	if (s<0) return 0;
+	const uint32_t* rstart=cols+(size_t)gimgStart*hdr->nrecs;
+	const uint32_t* rend=cols+(size_t)gimgEnd*hdr->nrecs;
+	//records overlapping start..end must start at or after start-maxspan
+	uint minstart=(start>seqs[s].maxspan) ? start-seqs[s].maxspan : 0;
+	int l=seqs[s].first, r=seqs[s].first+seqs[s].count;
+	while (l<r) {
+		int m=(l+r)>>1;
+		if (rstart[m]<minstart) l=m+1;
+		else r=m;
+	}
+	int found=0;
+	int last=seqs[s].first+seqs[s].count;
+	for (int i=l;i<last && rstart[i]<=end;i++) {
+		if (rend[i]>=start) {
+			idxs.cAdd(i);
+			found++;
+		}
+	}
+	return found;
+}
+
+GffImageRec::GffImageRec(const GffImage* image, uint i):img(image), idx(i) {
+	start=col(gimgStart);
+	end=col(gimgEnd);
+	CDstart=col(gimgCDStart);
+	CDend=col(gimgCDEnd);
+	strand=img->strands[idx];
+}
+
+const char* GffImageRec::getGSeqName() {
+	uint32_t s=col(gimgSeq);
+	return (s<img->hdr->nseqs) ? img->seqName(s) : NULL;
+}
+
+int GffImageRec::parentIdx() {
+	uint32_t p=col(gimgParent);
+	return (p>=img->hdr->nrecs) ? -1 : (int)p;
+}
+
+const char* GffImageRec::getAttr(const char* attrname) {
+	int a=img->attrIndex(attrname);
+	if (a<0) return NULL;
+	return str(img->attrcols[(size_t)a*img->hdr->nrecs+idx]);
+}
+
+void GffImageRec::getExons(GVec<GSeg>& exons) {
+	exons.Clear();
+	uint32_t eofs=col(gimgExonOfs);
+	if (eofs>=img->exlen) return;
+	int ecount=exonCount();
+	const uchar* p=img->exondata+eofs;
+	const uchar* pend=img->exondata+img->exlen;
+	uint prev=start;
+	for (int e=0;e<ecount;e++) {
+		uint d=0, elen=0;
+		p=gimg_getVarint(p, pend, d);
+		if (p!=NULL) p=gimg_getVarint(p, pend, elen);
+		if (p==NULL) break; //corrupt exon data
+		GSeg ex(prev+d, prev+d+elen);
+		exons.Add(ex);
+		prev=ex.end;
+	}
+}
@@ -0,0 +1,85 @@
+/*
+ * GffIndex.cpp
+ *
+ *  region index for GFF/GTF/BED files (plain or BGZF compressed)
+ */
+
+#include "GffIndex.h"
+
+#define GFFIDX_MAGIC "GFI\001"
+#define ERR_GFFIDX_READ "Error reading region index file %s!\n"
+
+bool GffIndex::getRange(const char* gseq, uint start, uint end, int64& vfrom, int64& vto) {
+	vfrom=-1; vto=-1;
+	GffIdxSeq* s=seqs.Find(gseq);
+	if (s==NULL || end<start) return false;
+	int nw=s->wmin.Count();
+	//a record overlapping start..end starts at or after start-maxspan,
+	//and all its lines start at or before end+maxspan
+	uint rstart=(start>(uint)s->maxspan) ? start-s->maxspan : 0;
+	int w0=rstart>>GFFIDX_WINSHIFT;
+	int64 rend=(int64)end+s->maxspan;
+	int w1=(int)GMIN(rend>>GFFIDX_WINSHIFT, (int64)nw-1);
+	for (int w=w0;w<nw;w++) {
+		if (s->wmin[w]>=0 && (vfrom<0 || s->wmin[w]<vfrom)) vfrom=s->wmin[w];
+	}
+	for (int w=0;w<=w1;w++) {
+		if (s->wmax[w]>vto) vto=s->wmax[w];
+	}
+	return (vfrom>=0 && vto>=vfrom);
+}
+
+int GffIndex::storeIndex(const char* finame) {
+	FILE* f=fopen(finame, "wb");
+	if (f==NULL) GError("Error creating region index file: %s\n", finame);
+	int scount=0;
+	int32_t n=seqlist.Count();
+	bool ok=(fwrite(GFFIDX_MAGIC, 1, 4, f)==4 && fwrite(&n, sizeof(n), 1, f)==1);
+	for (int i=0;ok && i<n;i++) {
+		GffIdxSeq* s=seqlist[i];
+		int32_t nlen=strlen(s->name);
+		int32_t nw=s->wmin.Count();
+		ok=(fwrite(&nlen, sizeof(nlen), 1, f)==1 && fwrite(s->name, 1, nlen, f)==(size_t)nlen &&
+			fwrite(&(s->maxspan), sizeof(int32_t), 1, f)==1 && fwrite(&nw, sizeof(nw), 1, f)==1 &&
+			fwrite(s->wmin(), sizeof(int64), nw, f)==(size_t)nw &&
+			fwrite(s->wmax(), sizeof(int64), nw, f)==(size_t)nw);
+		if (ok) scount++;
+	}
+	fclose(f);
+	return scount;
+}
+
+int GffIndex::loadIndex(const char* finame) {
+	FILE* f=fopen(finame, "rb");
+	if (f==NULL) {
+		GMessage("Warning: cannot open region index file: %s!\n", finame);
+		return 0;
+	}
+	seqs.Clear();
+	seqlist.Clear();
+	char magic[4];
+	int32_t n=0;
+	if (fread(magic, 1, 4, f)!=4 || memcmp(magic, GFFIDX_MAGIC, 4)!=0 ||
+			fread(&n, sizeof(n), 1, f)!=1)
+		GError("Error: invalid region index file %s!\n", finame);
+	char* name=NULL;
+	for (int i=0;i<n;i++) {
+		int32_t nlen=0, nw=0;
+		if (fread(&nlen, sizeof(nlen), 1, f)!=1 || nlen<=0) GError(ERR_GFFIDX_READ, finame);
+		GREALLOC(name, nlen+1);
+		if (fread(name, 1, nlen, f)!=(size_t)nlen) GError(ERR_GFFIDX_READ, finame);
+		name[nlen]=0;
+		GffIdxSeq* s=addSeq(name);
+		if (fread(&(s->maxspan), sizeof(int32_t), 1, f)!=1 ||
+				fread(&nw, sizeof(nw), 1, f)!=1 || nw<0) GError(ERR_GFFIDX_READ, finame);
+		s->wmin.growTo(nw);
+		s->wmax.growTo(nw);
+		for (int w=0;w<nw;w++) { s->wmin.Add(-1); s->wmax.Add(-1); }
+		if (nw>0 && (fread(s->wmin(), sizeof(int64), nw, f)!=(size_t)nw ||
+				fread(s->wmax(), sizeof(int64), nw, f)!=(size_t)nw))
+			GError(ERR_GFFIDX_READ, finame);
+	}
+	GFREE(name);
+	fclose(f);
+	return seqlist.Count();
+}
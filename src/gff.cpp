@@ -1,6 +1,10 @@
 #include "gff.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <zlib.h>
 
-GffNames* GffObj::names=NULL;
 //global set of feature names, attribute names etc.
 // -- common for all GffObjs in current application!
 
@@ -8,6 +12,9 @@ const uint GFF_MAX_LOCUS = 7000000; //longest known gene in human is ~2.2M, UCSC
 const uint GFF_MAX_EXON  =   30000; //longest known exon in human is ~11K
 const uint GFF_MAX_INTRON= 6000000; //Ensembl shows a >5MB mouse intron
 const int  GFF_MIN_INTRON = 4; //for mergeCloseExons option
+const int  GFF_PARTSIZE = GBLOCK_READSIZE<<1; //input bytes parsed by each readAll(nthreads) thread at a time
+const int  GFF_MAX_PARTS = 256; //limits the size of a readAll(nthreads) input block
+const int  GFF_MAX_RESERVE_IDS = 1<<18; //reserveIds() cap, about the number of human transcripts
 //bool gff_show_warnings = false; //global setting, set by GffReader->showWarnings()
 int gff_fid_mRNA=0; //mRNA (has CDS)
 int gff_fid_transcript=1; // generic "transcript" feature
@@ -20,6 +27,66 @@ const GffScore GFFSCORE_NONE;
 //const uint gfo_flag_LEVEL_MSK        = 0x00FF0000;
 //const byte gfo_flagShift_LEVEL           = 16;
 
+GffNameList::GffNameList(int init_capacity):table(NULL), fCount(0), idlast(-1), addlock() {
+  uint cap=16;
+  while (cap<(uint)init_capacity*2) cap<<=1;
+  table.store(new NameTable(cap, NULL));
+  for (int i=0;i<GFFNAMES_MAXSEGS;i++) segs[i].store(NULL);
+}
+
+GffNameList::~GffNameList() {
+  int n=fCount.load();
+  for (int i=0;i<n;i++) delete Get(i);
+  for (int i=0;i<GFFNAMES_MAXSEGS;i++) {
+    GffNameInfo** sg=segs[i].load();
+    GFREE(sg);
+  }
+  NameTable* t=table.load();
+  while (t!=NULL) {
+    NameTable* p=t->prev;
+    delete t;
+    t=p;
+  }
+}
+
+int GffNameList::insertName(const char* tname, uint h) {
+  std::lock_guard<std::mutex> lock(addlock);
+  GffNameInfo* f=findName(tname, h); //could have been added by another thread
+  if (f!=NULL) return f->idx;
+  GArenaScope noarena(NULL); //names are shared, keep them out of any arena
+  int fidx=fCount.load(std::memory_order_relaxed);
+  int ofs=0;
+  int sg=segIndex(fidx, ofs);
+  if (sg>=GFFNAMES_MAXSEGS)
+    GError("GffNameList Error: too many names (%d)!\n", fidx);
+  GffNameInfo** seg=segs[sg].load(std::memory_order_relaxed);
+  if (seg==NULL) {
+    GMALLOC(seg, (sizeof(GffNameInfo*)<<GFFNAMES_SEGBITS)<<sg);
+    segs[sg].store(seg, std::memory_order_release);
+  }
+  f=new GffNameInfo(tname);
+  f->idx=fidx;
+  seg[ofs]=f;
+  //the id is valid before the name can be found
+  fCount.store(fidx+1, std::memory_order_release);
+  NameTable* t=table.load(std::memory_order_relaxed);
+  if ((uint)(fidx+1)*2>t->mask) { //keep the load factor under 50%
+    NameTable* nt=new NameTable((t->mask+1)<<1, t);
+    for (int i=0;i<fidx;i++) {
+      GffNameInfo* e=Get(i);
+      uint j=e->hash & nt->mask;
+      while (nt->slots[j].load(std::memory_order_relaxed)!=NULL) j=(j+1) & nt->mask;
+      nt->slots[j].store(e, std::memory_order_relaxed);
+    }
+    table.store(nt, std::memory_order_release);
+    t=nt;
+  }
+  uint j=h & t->mask;
+  while (t->slots[j].load(std::memory_order_relaxed)!=NULL) j=(j+1) & t->mask;
+  t->slots[j].store(f, std::memory_order_release);
+  return fidx;
+}
+
 void gffnames_ref(GffNames* &n) {
   if (n==NULL) n=new GffNames();
   n->numrefs++;
@@ -27,8 +94,8 @@ void gffnames_ref(GffNames* &n) {
 
 void gffnames_unref(GffNames* &n) {
   if (n==NULL) GError("Error: attempt to remove reference to null GffNames object!\n");
-  n->numrefs--;
-  if (n->numrefs==0) { delete n; n=NULL; }
+  if (--(n->numrefs)==0) { delete n; }
+  n=NULL;
 }
 
 const int CLASSCODE_OVL_RANK = 15;
@@ -66,7 +133,7 @@ const char* strExonType(char xtype) {
 int gfo_cmpByLoc(const pointer p1, const pointer p2) {
  GffObj& g1=*((GffObj*)p1);
  GffObj& g2=*((GffObj*)p2);
- if (g1.gseq_id==g2.gseq_id) {
+ if (g1.cmpGSeq(g2)==0) {
              if (g1.start!=g2.start)
                     return (int)(g1.start-g2.start);
                else if (g1.getLevel()!=g2.getLevel())
@@ -84,7 +151,8 @@ int gfo_cmpByLoc(const pointer p1, const pointer p2) {
 int gfo_cmpRefByID(const pointer p1, const pointer p2) {
  GffObj& g1=*((GffObj*)p1);
  GffObj& g2=*((GffObj*)p2);
- if (g1.gseq_id==g2.gseq_id) {
+ int c=g1.cmpGSeq(g2);
+ if (c==0) {
              if (g1.start!=g2.start)
                     return (int)(g1.start-g2.start);
                else if (g1.getLevel()!=g2.getLevel())
@@ -94,13 +162,15 @@ int gfo_cmpRefByID(const pointer p1, const pointer p2) {
                               return (int)(g1.end-g2.end);
                         else return strcmp(g1.getID(), g2.getID());
              }
-             else return (g1.gseq_id-g2.gseq_id); // sort refs by their id# order
+             else return c; // sort refs by their id# order
 }
 
 char* GffLine::extractGFFAttr(char* & infostr, const char* oline, const char* attr, bool caseStrict,
-		   bool enforce_GTF2, int* rlen, bool deleteAttr) {
+		   bool enforce_GTF2, int* rlen, bool deleteAttr, char** vstore) {
  //parse a key attribute and remove it from the info string
  //(only works for attributes that have values following them after ' ' or '=')
+ //if vstore is given, the value is copied at *vstore (which is then advanced past it)
+ // instead of being returned as a new allocated string
  static const char GTF2_ERR[]="Error parsing attribute %s ('\"' required for GTF) at line:\n%s\n";
  int attrlen=strlen(attr);
  char cend=attr[attrlen-1];
@@ -160,7 +230,14 @@ char* GffLine::extractGFFAttr(char* & infostr, const char* oline, const char* at
     }
  if (enforce_GTF2 && *vend!='"')
      GError(GTF2_ERR, attr, oline);
- char *r=Gstrdup(vp, vend-1);
+ char *r=NULL;
+ if (vstore) {
+	 r=*vstore;
+	 memcpy(r, vp, vend-vp);
+	 r[vend-vp]=0;
+	 *vstore+=vend-vp+1;
+ }
+ else r=Gstrdup(vp, vend-1);
  if (rlen) *rlen = vend-vp;
  if (deleteAttr) {//-- remove this attribute from infostr
 	 while (*vend!=0 && (*vend=='"' || *vend==';' || *vend==' ')) vend++;
@@ -172,6 +249,127 @@ char* GffLine::extractGFFAttr(char* & infostr, const char* oline, const char* at
  }
  return r;
 }
+//known attribute names, indexed by GffAttrKey, in the case required by the strict lookups
+static const char* gffAttrKeyNames[GFF_NUM_ATTRKEYS]={
+	"ID", "Parent", "transcript_id", "gene_id", "gene_name", "geneName", "gene_sym", "gene",
+	"geneID", "exons", "exonCount", "CDS", "CDSphase", "locus", "genesymbol" };
+static const int8_t gffAttrKeyLens[GFF_NUM_ATTRKEYS]={2, 6, 13, 7, 9, 8, 8, 4, 6, 5, 9, 3, 8, 5, 10};
+
+//perfect hash of the known names: (len + lc(last char) + 4*lc(middle char)) & 31
+static const int8_t gffAttrKeyHash[32]={
+	-1, gakGene, -1, -1, gakLocus, gakGeneNameAlt, gakCDS, -1,
+	-1, gakExonCount, gakGeneName, -1, -1, gakCDSphase, gakParent, -1,
+	-1, gakGeneSym, -1, -1, gakExons, -1, gakID, -1,
+	-1, gakTranscriptID, gakGeneSymbol, -1, -1, -1, gakGeneIDAlt, gakGeneID };
+
+int8_t gffAttrKey(const char* k, int klen) {
+	if (klen<2 || klen>13) return gakNone;
+	int8_t kid=gffAttrKeyHash[(klen+(k[klen-1]|0x20)+((k[klen>>1]|0x20)<<2)) & 31];
+	if (kid<0 || gffAttrKeyLens[kid]!=klen || Gstricmp(gffAttrKeyNames[kid], k, klen)!=0)
+		return gakNone;
+	return kid;
+}
+
+void GffLine::tokenizeAttrs(GArena* inplace) {
+	//one token per ';' delimited attribute, at most
+	int maxtoks=1;
+	for (const char* c=info;(c=strchr(c, ';'))!=NULL;c++) maxtoks++;
+	if (inplace) attrToks=(GffAttrTok*)inplace->alloc(maxtoks*sizeof(GffAttrTok));
+	else GMALLOC(attrToks, maxtoks*sizeof(GffAttrTok));
+	int aklast[GFF_NUM_ATTRKEYS];
+	char* p=info;
+	while (*p!=0) {
+		while (*p==' ' || *p==';') p++;
+		if (*p==0) break;
+		GffAttrTok& t=attrToks[numAttrToks];
+		t.key=p-line;
+		while (*p!=0 && *p!='=' && *p!=' ' && *p!=';') p++;
+		t.klen=p-line-t.key;
+		t.sep=(*p=='=' || *p==' ') ? *p++ : 0;
+		while (*p==' ') p++;
+		if (t.sep==' ' && *p=='=') { //name = value
+			t.sep=*p++;
+			while (*p==' ') p++;
+		}
+		t.val=p-line;
+		if (*p=='"') { //a ';' in a double-quoted value does not end it
+			char* q=p+1;
+			while (*q!='"' && *q!=0) q++;
+			if (*q=='"') p=q+1;
+		}
+		while (*p!=';' && *p!=0) p++;
+		t.vlen=p-line-t.val;
+		t.next=-1;
+		t.deleted=false;
+		t.numcol=-1;
+		t.kid=gffAttrKey(line+t.key, t.klen);
+		if (t.kid>=0) {
+			if (_akfirst[t.kid]<0) _akfirst[t.kid]=numAttrToks;
+			else attrToks[aklast[t.kid]].next=numAttrToks;
+			aklast[t.kid]=numAttrToks;
+		}
+		numAttrToks++;
+	}
+}
+
+char* GffLine::_extractAttr(GffAttrKey k, char sep, bool caseStrict, bool enforce_GTF2, bool deleteAttr) {
+	//same rules as extractGFFAttr(), with a GTF attribute (sep ' ') also found at the end of info
+	static const char GTF2_ERR[]="Error parsing attribute %s ('\"' required for GTF) at line:\n%s\n";
+	int i=_akfirst[k];
+	for (;i>=0;i=attrToks[i].next) {
+		GffAttrTok& t=attrToks[i];
+		if (t.deleted || (t.sep!=sep && !(sep==' ' && t.sep==0 && line[t.val]==0))) continue;
+		if (caseStrict && memcmp(line+t.key, gffAttrKeyNames[k], t.klen)!=0) continue;
+		break;
+	}
+	if (i<0) return NULL;
+	GffAttrTok& t=attrToks[i];
+	if (t.vlen==0) {
+		GMessage("Warning: cannot parse value of GFF attribute \"%s%s\" at line:\n%s\n",
+				gffAttrKeyNames[k], (sep=='=') ? "=" : "", dupline);
+		return NULL;
+	}
+	char* vp=line+t.val;
+	char* vend=vp+t.vlen;
+	bool dq_enclosed=(*vp=='"');
+	if (dq_enclosed) {
+		vp++;
+		char* q=vp;
+		while (q<vend && *q!='"') q++;
+		vend=q;
+	}
+	if (enforce_GTF2 && (!dq_enclosed || *vend!='"'))
+		GError(GTF2_ERR, gffAttrKeyNames[k], dupline);
+	if (deleteAttr) t.deleted=true;
+	return _storeValue(vp, vend-1);
+}
+
+void GffLine::finishAttrs(bool gtf) {
+	//the remaining attributes are written back to info as name=value pairs,
+	//then their names and values in line[] are terminated in place
+	char* p=_vfree;
+	for (int i=0;i<numAttrToks;i++) {
+		GffAttrTok& t=attrToks[i];
+		if (t.deleted) continue;
+		if (p>_vfree) *p++=';';
+		memcpy(p, line+t.key, t.klen);
+		p+=t.klen;
+		if (t.sep) *p++ = gtf ? '=' : t.sep;
+		memcpy(p, line+t.val, t.vlen);
+		p+=t.vlen;
+		//only name=value pairs are attributes (in GTF, any name followed by a value)
+		if (t.sep!='=' && !(gtf && t.sep!=0)) t.deleted=true;
+	}
+	*p=0;
+	info=_vfree;
+	_vfree=p+1;
+	for (int i=0;i<numAttrToks;i++) {
+		GffAttrTok& t=attrToks[i];
+		line[t.key+t.klen]=0;
+		line[t.val+t.vlen]=0;
+	}
+}
+
 BEDLine::BEDLine(GffReader* reader, const char* l): skip(true), dupline(NULL), line(NULL), llen(0),
 		gseqname(NULL), fstart(0), fend(0), strand(0), ID(NULL), info(NULL),
 		cds_start(0), cds_end(0), cds_phase(0), exons(1) {
@@ -183,20 +381,11 @@ BEDLine::BEDLine(GffReader* reader, const char* l): skip(true), dupline(NULL), l
   memcpy(dupline, l, llen+1);
   char* t[14];
   int i=0;
-  int tidx=1;
-  t[0]=line;
   if (startsWith(line, "browser ") || startsWith(line, "track "))
 	  return;
-  while (line[i]!=0) {
-   if (line[i]=='\t') {
-    line[i]=0;
-    t[tidx]=line+i+1;
-    tidx++;
-    //our custom BED-13+ format, with GFF3 attributes in 13th column
-    if (tidx>12) { info=t[12]; break; }
-   }
-   i++;
-  }
+  int tidx=splitTabs(line, llen, t, 13);
+  //our custom BED-13+ format, with GFF3 attributes in 13th column
+  if (tidx>12) info=t[12];
   /* if (tidx<6) { // require BED-6+ lines
    GMessage("Warning: 6+ BED columns expected, instead found:\n%s\n", l);
    return;
@@ -204,13 +393,13 @@ BEDLine::BEDLine(GffReader* reader, const char* l): skip(true), dupline(NULL), l
   */
   gseqname=t[0];
   char* p=t[1];
-  if (!parseUInt(p,fstart)) {
+  if (!parseUIntField(p,fstart)) {
     GMessage("Warning: invalid BED start coordinate at line:\n%s\n",l);
     return;
     }
   ++fstart; //BED start is 0 based
   p=t[2];
-  if (!parseUInt(p,fend)) {
+  if (!parseUIntField(p,fend)) {
     GMessage("Warning: invalid BED end coordinate at line:\n%s\n",l);
     return;
     }
@@ -364,31 +553,32 @@ bool GffLine::parseSegmentList(GVec<GSeg>& segs, char* str) {
 	return segs_valid;
 }
 
-GffLine::GffLine(GffReader* reader, const char* l): _parents(NULL), _parents_len(0),
-		dupline(NULL), line(NULL), llen(0), gseqname(NULL), track(NULL),
+GffLine::GffLine(GffReader* reader, const char* l, int l_len, GArena* inplace): _parents(NULL), _parents_len(0),
+		_par1(NULL), _vfree(NULL), _ownbuf(inplace==NULL), dupline(NULL), line(NULL), llen(0), gseqname(NULL), track(NULL),
 		ftype(NULL), ftype_id(-1), info(NULL), fstart(0), fend(0), //qstart(0), qend(0), qlen(0),
 		score(0), score_decimals(-1), strand(0), flags(0), exontype(exgffNone), phase(0), cds_start(0), cds_end(0),
-		exons(), cdss(), gene_name(NULL), gene_id(NULL), parents(NULL), num_parents(0), ID(NULL) {
- llen=strlen(l);
- GMALLOC(line,llen+1);
+		exons(0), cdss(0), gene_name(NULL), gene_id(NULL), parents(NULL), num_parents(0), ID(NULL),
+		attrToks(NULL), numAttrToks(0) {
+ memset(_akfirst, 0xFF, sizeof(_akfirst));
+ llen=(l_len<0) ? strlen(l) : l_len;
+ //buffer layout: line[] copy, then the attribute value area; the extracted values are
+ // substrings of info, and so is the rebuilt info (see finishAttrs()), so 3 lengths are enough
+ int blen=(llen+1)<<2;
+ if (inplace) {
+	 line=(char*)inplace->alloc(blen);
+	 dupline=(char*)l;
+ }
+ else {
+	 GMALLOC(line, blen+llen+1);
+	 dupline=line+blen;
+	 memcpy(dupline, l, llen+1);
+ }
  memcpy(line, l, llen+1);
- GMALLOC(dupline, llen+1);
- memcpy(dupline, l, llen+1);
+ _vfree=line+llen+1;
  skipLine=true; //clear only if we make it to the end of this function
  char* t[9];
- int i=0;
- int tidx=1;
- t[0]=line;
  char fnamelc[128];
- while (line[i]!=0) {
-  if (line[i]=='\t') {
-   line[i]=0;
-   t[tidx]=line+i+1;
-   tidx++;
-   if (tidx>8) break;
-   }
-  i++;
-  }
+ int tidx=splitTabs(line, llen, t, 9);
  if (tidx<8) { // ignore non-GFF lines
   return;
  }
@@ -398,13 +588,13 @@ GffLine::GffLine(GffReader* reader, const char* l): _parents(NULL), _parents_len
  ftype=t[2];
  info=t[8];
  char* p=t[3];
- if (!parseUInt(p,fstart)) {
+ if (!parseUIntField(p,fstart)) {
    //chromosome_band entries in Flybase
    GMessage("Warning: invalid start coordinate at line:\n%s\n",l);
    return;
    }
  p=t[4];
- if (!parseUInt(p,fend)) {
+ if (!parseUIntField(p,fend)) {
    GMessage("Warning: invalid end coordinate at line:\n%s\n",l);
    return;
    }
@@ -428,7 +618,7 @@ GffLine::GffLine(GffReader* reader, const char* l): _parents(NULL), _parents_len
 	  while ((*pde)!=0) ++pde;
 	  score_decimals=pde-pd;
   }
-  if (!parseFloat(p, score))
+  if (!parseFloatField(p, score))
        GError("Error parsing feature score from GFF line:\n%s\n",l);
 
   }
@@ -485,7 +675,7 @@ GffLine::GffLine(GffReader* reader, const char* l): _parents(NULL), _parents_len
  else if ((someRNA=endsWith(fnamelc,"rna")) || endsWith(fnamelc,"transcript")) { // || startsWith(fnamelc+1, "rna")) {
 	 is_transcript=true;
 	 is_t_data=true;
-	 if (someRNA) ftype_id=GffObj::names->feats.addName(ftype);
+	 is_rna=someRNA;
  }
  else if (endsWith(fnamelc, "_gene_segment")) {
 	 is_transcript=true;
@@ -496,6 +686,26 @@ GffLine::GffLine(GffReader* reader, const char* l): _parents(NULL), _parents_len
 	 is_gene=true;
 	 is_t_data=true; //because its name will be attached to parented transcripts
  }
+ //lock-free lookup, a new feature name is only added by noteGffLine()
+ if (is_rna) ftype_id=reader->names->feats.getId(ftype);
+ tokenizeAttrs(inplace);
+ //the input dialect is known after the first lines, then a specialized parser is used
+ bool clean=reader->clean_Annotation && cleanAttrs();
+ if (reader->is_gff3) {
+	 if (clean) parseKeyAttrs<GffDialectGFF3Clean>(reader, l, inplace, is_t_data);
+	 else parseKeyAttrs<GffDialectGFF3>(reader, l, inplace, is_t_data);
+ }
+ else if (reader->is_gtf) {
+	 if (clean) parseKeyAttrs<GffDialectGTFClean>(reader, l, inplace, is_t_data);
+	 else parseKeyAttrs<GffDialectGTF>(reader, l, inplace, is_t_data);
+ }
+ else parseKeyAttrs<GffDialectAny>(reader, l, inplace, is_t_data);
+}
+
+template <class D> void GffLine::parseKeyAttrs(GffReader* reader, const char* l, GArena* inplace, bool is_t_data) {
+ //with a known dialect, D::gff3 replaces the run-time format checks
+ bool as_gff3=D::known ? D::gff3 : (reader->is_gff3 || reader->gff_type==0);
+ char* p=NULL;
  char* Parent=NULL;
  /*
   Rejecting non-transcript lines early if only transcripts are requested ?!
@@ -508,24 +718,22 @@ GffLine::GffLine(GffReader* reader, const char* l): _parents(NULL), _parents_len
  if (reader->ignoreLocus) {
 	 if (strcmp(ftype, "locus")==0) return;
 	 if (is_transcript || is_gene) {
-		 char* locus=NULL;
-        if (reader->is_gff3 || reader->gff_type==0)
-        	locus=extractAttr("locus=");
-		else locus=extractAttr("locus");
-        if (locus!=NULL) { GFREE(locus); }
+		 if (as_gff3)
+			 _extractAttr(gakLocus, '=');
+		 else _extractAttr(gakLocus, ' ');
 	 }
  }
  char *gtf_tid=NULL;
  char *gtf_gid=NULL;
- if (reader->is_gff3 || reader->gff_type==0) {
-	ID=extractAttr("ID=",true);
-	Parent=extractAttr("Parent=",true);
-	if (reader->gff_type==0) {
+ if (as_gff3) {
+	ID=_extractAttr(gakID, '=', true);
+	Parent=_extractAttr(gakParent, '=', true);
+	if (!D::known && reader->gff_type==0) {
 		if (ID!=NULL || Parent!=NULL) reader->is_gff3=true;
 			else { //check if it looks like a GTF
-				gtf_tid=extractAttr("transcript_id", true, true);
+				gtf_tid=_extractAttr(gakTranscriptID, ' ', true, true);
 				if (gtf_tid==NULL) {
-					gtf_gid=extractAttr("gene_id", true, true);
+					gtf_gid=_extractAttr(gakGeneID, ' ', true, true);
 					if (gtf_gid==NULL) return; //cannot determine file type yet
 				}
 				reader->is_gtf=true;
@@ -533,26 +741,26 @@ GffLine::GffLine(GffReader* reader, const char* l): _parents(NULL), _parents_len
 	}
  }
 
- if (reader->is_gff3) {
+ if (D::known ? D::gff3 : reader->is_gff3) {
 	 //parse as GFF3
 	 //if (ID==NULL && Parent==NULL) return; //silently ignore unidentified/unlinked features
 	 if (ID!=NULL) {
 		 //has ID attr so it's likely to be a parent feature
 
 		 //look for explicit gene name
-		 gene_name=getAttrValue("gene_name=");
+		 gene_name=_extractAttr(gakGeneName, '=', false, false, false);
 		 if (gene_name==NULL) {
-			 gene_name=getAttrValue("geneName=");
+			 gene_name=_extractAttr(gakGeneNameAlt, '=', false, false, false);
 			 if (gene_name==NULL) {
-				 gene_name=getAttrValue("gene_sym=");
+				 gene_name=_extractAttr(gakGeneSym, '=', false, false, false);
 				 if (gene_name==NULL) {
-					 gene_name=getAttrValue("gene=");
+					 gene_name=_extractAttr(gakGene, '=', false, false, false);
 				 }
 			 }
 		 }
-		 gene_id=getAttrValue("geneID=");
+		 gene_id=_extractAttr(gakGeneIDAlt, '=', false, false, false);
 		 if (gene_id==NULL) {
-			 gene_id=getAttrValue("gene_id=");
+			 gene_id=_extractAttr(gakGeneID, '=', false, false, false);
 		 }
 		 /*
 		 if (is_gene) { //--WARNING: this might be mislabeled (e.g. TAIR: "mRNA_TE_gene")
@@ -566,23 +774,21 @@ GffLine::GffLine(GffReader* reader, const char* l): _parents(NULL), _parents_len
 			 //-- we don't care about gene parents.. unless it's a mislabeled "gene" feature
 		 } //gene feature (probably)
 		*/
-		 //--parse exons for TLF
-		 char* segstr=extractAttr("exons=");
+		 //--parse exons for TLF (clean annotation has no exons= attributes)
+		 char* segstr=D::clean ? NULL : _extractAttr(gakExons, '=');
 		 bool exons_valid=false;
 		 if (segstr) {
 			 exons_valid=parseSegmentList(exons, segstr);
-			 char* exoncountstr=extractAttr("exonCount=");
+			 char* exoncountstr=_extractAttr(gakExonCount, '=');
 			 if (exoncountstr) {
 				 int exoncount=0;
 				 if (!strToInt(exoncountstr, exoncount) || exoncount!=(int)exons.Count())
 					 GMessage("Warning: exonCount attribute value doesn't match the exons attribute!\n");
-				 GFREE(exoncountstr);
 			 }
-			 GFREE(segstr);
 		 }
 		 if (exons_valid) {
 			 bool validCDS=false;
-			 segstr=extractAttr("CDS=");
+			 segstr=_extractAttr(gakCDS, '=');
 			 if (segstr) {
 				 char* p=strchr(segstr, ':');
 				 if (p!=NULL) { // CDS=start:end format
@@ -607,13 +813,11 @@ GffLine::GffLine(GffReader* reader, const char* l): _parents(NULL), _parents_len
 						 if (cds_end==0) cds_end=cdss.Last().end;
 					 }
 				 }
-				 GFREE(segstr);
 			 }
 			 if (validCDS) {
 				 char* cds_phase=NULL;
-				 if ((cds_phase=extractAttr("CDSphase="))!=NULL) {
+				 if ((cds_phase=_extractAttr(gakCDSphase, '='))!=NULL) {
 					 phase=cds_phase[0];
-					 GFREE(cds_phase);
 				 }
 			 } //CDS found
 		 }//has valid exons
@@ -633,7 +837,9 @@ GffLine::GffLine(GffReader* reader, const char* l): _parents(NULL), _parents_len
 		 }
 		 _parents_len=p-Parent+1;
 		 _parents=Parent;
-		 GMALLOC(parents, num_parents*sizeof(char*));
+		 if (num_parents==1) parents=&_par1;
+		 else if (inplace) parents=(char**)inplace->alloc(num_parents*sizeof(char*));
+		 else GMALLOC(parents, num_parents*sizeof(char*));
 		 parents[0]=_parents;
 		 int i=1;
 		 if (last_delim_pos>0) {
@@ -650,7 +856,7 @@ GffLine::GffLine(GffReader* reader, const char* l): _parents(NULL), _parents_len
 	 } //has Parent field
 	 //special case for gene_id: for genes, this is the ID
 	 if (is_gene && gene_id==NULL && ID!=NULL) {
-	    	 gene_id=Gstrdup(ID);
+	    	 gene_id=ID;
 	 }
 	 //parse other potentially useful GFF3 attributes
 	 /*
@@ -697,44 +903,41 @@ GffLine::GffLine(GffReader* reader, const char* l): _parents(NULL), _parents_len
 		 return; //alwasys skip unrecognized non-transcript features in GTF
 	 }
 	 if (is_gene) {
-		 reader->gtf_gene=true;
-		 ID = (gtf_tid!=NULL) ? gtf_tid : extractAttr("transcript_id", true, true); //Ensemble GTF might lack this
-		 gene_id = (gtf_gid!=NULL) ? gtf_gid : extractAttr("gene_id", true, true);
+		 ID = (gtf_tid!=NULL) ? gtf_tid : _extractAttr(gakTranscriptID, ' ', true, true); //Ensemble GTF might lack this
+		 gene_id = (gtf_gid!=NULL) ? gtf_gid : _extractAttr(gakGeneID, ' ', true, true);
 		 if (ID==NULL) {
 			 //no transcript_id -- this should not be valid GTF2 format, but Ensembl (Gencode?)
 			 //has being known to add "gene" features with only gene_id in their GTF
 			 if (gene_id!=NULL) { //likely a gene feature line (Ensembl!)
-			 		 ID=Gstrdup(gene_id); //take over as ID (for defective GTF lacking transcript_id)
+			 		 ID=gene_id; //take over as ID (for defective GTF lacking transcript_id)
 			 }
 		 }
 		 // else if (strcmp(gene_id, ID)==0) //GENCODE v20 gene feature ?
 	 }
 	 else if (is_transcript) {
-		 ID = (gtf_tid!=NULL) ? gtf_tid : extractAttr("transcript_id", true, true);
+		 ID = (gtf_tid!=NULL) ? gtf_tid : _extractAttr(gakTranscriptID, ' ', true, true);
 		//gene_id=extractAttr("gene_id"); // for GTF this is the only attribute accepted as geneID
 		 if (ID==NULL) {
 			 	 //something is wrong here, cannot parse the GTF ID
 				 GMessage("Warning: invalid GTF record, transcript_id not found:\n%s\n", l);
 				 return;
 		 }
-		 gene_id = (gtf_gid!=NULL) ? gtf_gid : extractAttr("gene_id", true, true);
+		 gene_id = (gtf_gid!=NULL) ? gtf_gid : _extractAttr(gakGeneID, ' ', true, true);
 		if (gene_id!=NULL)
-			Parent=Gstrdup(gene_id);
-		reader->gtf_transcript=true;
+			Parent=gene_id;
 		is_gtf_transcript=1;
 	 } else { //must be an exon type
-		 Parent = (gtf_tid!=NULL) ? gtf_tid : extractAttr("transcript_id", true, true);
-		 gene_id = (gtf_gid!=NULL) ? gtf_gid : extractAttr("gene_id", true, true); // for GTF this is the only attribute accepted as geneID
+		 Parent = (gtf_tid!=NULL) ? gtf_tid : _extractAttr(gakTranscriptID, ' ', true, true);
+		 gene_id = (gtf_gid!=NULL) ? gtf_gid : _extractAttr(gakGeneID, ' ', true, true); // for GTF this is the only attribute accepted as geneID
 		 //old pre-GTF2 formats like Jigsaw's (legacy support)
-		 if (Parent==NULL && exontype==exgffExon) {
+		 if (!D::clean && Parent==NULL && exontype==exgffExon) {
 			 if (startsWith(track,"jigsaw")) {
 				 is_cds=true;
 				 strcpy(track,"jigsaw");
 				 p=strchr(info,';');
-				 if (p==NULL) { Parent=Gstrdup(info); info=NULL; }
-				 else { Parent=Gstrdup(info,p-1);
-				 info=p+1;
-				 }
+				 if (p==NULL) Parent=_storeValue(info, info+strlen(info)-1);
+				 else Parent=_storeValue(info,p-1);
+				 if (numAttrToks>0) attrToks[0].deleted=true;
 			 }
 		 }
 		 if (Parent==NULL) {
@@ -745,44 +948,41 @@ GffLine::GffLine(GffReader* reader, const char* l): _parents(NULL), _parents_len
 	 }
 	 //more GTF attribute parsing
 	 if (is_gene && gene_id==NULL && ID!=NULL)
-    	 gene_id=Gstrdup(ID);
-	 gene_name=getAttrValue("gene_name");
+    	 gene_id=ID;
+	 gene_name=_extractAttr(gakGeneName, ' ', false, false, false);
 	 if (gene_name==NULL) {
-		 gene_name=getAttrValue("gene_sym");
+		 gene_name=_extractAttr(gakGeneSym, ' ', false, false, false);
 		 if (gene_name==NULL) {
-			 gene_name=getAttrValue("gene");
+			 gene_name=_extractAttr(gakGene, ' ', false, false, false);
 			 if (gene_name==NULL)
-				 gene_name=getAttrValue("genesymbol");
+				 gene_name=_extractAttr(gakGeneSymbol, ' ', false, false, false);
 		 }
 	 }
-	 //*** IMPORTANT: prepare GTF for easy parseAttr by adding '=' character after the attribute name
-	 //          for ALL attributes
-	 p=info;
-	 bool noed=true; //not edited after the last delim
-	 bool nsp=false; //non-space found after last delim
-	 while (*p!=0) {
-		 if (*p==' ') {
-			 if (nsp && noed) {
-				 *p='=';
-				 noed=false;
-				 p++;
-				 continue;
-			 }
-		 }
-		 else nsp=true; //non-space
-		 if (*p==';') { noed=true; nsp=false; }
-		 p++;
-	 }
 	 //-- GTF prepare parents[] if Parent found
 	 if (Parent!=NULL) { //GTF transcript_id found as a parent
 		 _parents=Parent;
 		 num_parents=1;
 		 _parents_len=strlen(Parent)+1;
-		 GMALLOC(parents, sizeof(char*));
+		 parents=&_par1;
 		 parents[0]=_parents;
 	 }
  } //GTF
-
+ if (reader->num_Attrs) { //numeric columns also take the attributes filtered out below
+	 for (int i=0;i<numAttrToks;i++) {
+		 GffAttrTok& t=attrToks[i];
+		 if (t.deleted) continue;
+		 int* c=reader->numAttrCols.FindLen(line+t.key, t.klen);
+		 if (c!=NULL) t.numcol=*c;
+	 }
+ }
+ if (reader->attr_Filter) { //attribute projection: drop the unwanted ones right here
+	 for (int i=0;i<numAttrToks;i++) {
+		 GffAttrTok& t=attrToks[i];
+		 if (!t.deleted && !reader->keepAttr(line+t.key, t.klen)) t.deleted=true;
+	 }
+ }
+ //GTF attributes are also written back as name=value pairs
+ finishAttrs(!(D::known ? D::gff3 : reader->is_gff3));
 
  if (ID==NULL && parents==NULL) {
 	 if (gffWarnings)
@@ -840,6 +1040,7 @@ void GffObj::setCDS(GffObj* t) {
 	          else exons[0]->exontype=exgffExon;
 	}
 	if (t->cdss!=NULL) {
+       flag_SEG_BOUNDS=false;
        if (this->cdss!=NULL) delete cdss;
        cdss=new GList<GffExon>(true, true, false);
        for (int i=0;i<t->cdss->Count();i++) {
@@ -913,12 +1114,13 @@ int GffObj::readExon(GffReader& reader, GffLine& gl) {
 	  GMessage("Warning: addExon() failed for GFF line:\n%s\n",gl.dupline);
 	  return eidx; //this should never happen!
   }
+  if (reader.num_Attrs) reader.noteNumAttrs(this, gl, true);
   if (reader.keep_Attrs) {
      if (reader.noExonAttrs) {
-           parseAttrs(attrs, gl.info, true);
+           parseAttrs(attrs, gl, true);
      }
      else { //need all exon-level attributes
-         parseAttrs((*segs)[eidx]->attrs, gl.info, true, gl.is_cds);
+         parseAttrs((*segs)[eidx]->attrs, gl, true, gl.is_cds);
      }
   }
   return eidx;
@@ -931,9 +1133,7 @@ int GffObj::addExon(GList<GffExon>& segs, GffLine& gl, int8_t exontype_override)
 	if (&segs==cdss && isGene() && gl.ID!=NULL && eidx>=0) {
      //special NCBI cases where CDS can be treated as discontiguous features, grouped by their ID
 	 //-- used for genes with X_gene_segment features
-	 //char* cds_id=Gstrdup(gl.ID);
-	 //segs[eidx]->uptr=cds_id;
-	 segs[eidx]->uptr=gl.ID;
+	 segs[eidx]->uptr=Gstrdup(gl.ID);
 	 gl.ID=NULL;
 	}
 	return eidx;
@@ -943,6 +1143,18 @@ int GffObj::exonOverlapIdx(GList<GffExon>& segs, uint s, uint e, int* ovlen, int
 	//return the exons' index for the overlapping OR ADJACENT exon
 	//ovlen, if given, will return the overlap length
 	//if (s>e) Gswap(s,e);
+	if (flag_SEG_BOUNDS && (&segs==&exons || &segs==cdss)) {
+		//binary search for the first segment starting at or after s-maxlen
+		uint maxlen=(&segs==&exons) ? exons_maxlen : cdss_maxlen;
+		uint minstart=(s>maxlen) ? s-maxlen : 0;
+		int l=start_idx, h=segs.Count();
+		while (l<h) {
+			int m=(l+h)>>1;
+			if (segs[m]->start<minstart) l=m+1;
+			else h=m;
+		}
+		start_idx=l;
+	}
 	for (int i=start_idx;i<segs.Count();i++) {
 		if (segs[i]->start>e+1) break;
 		if (s-1>segs[i]->end) continue;
@@ -960,10 +1172,21 @@ int GffObj::exonOverlapIdx(GList<GffExon>& segs, uint s, uint e, int* ovlen, int
 void GffObj::transferCDS(GffExon* cds) {
 	//direct adding of a cds to the cdss pointer, without checking
 	 if (cdss==NULL) cdss=new GList<GffExon>(true, true, false);
-	 cdss->Add(cds); //now the caller must forget this exon!
+	 cdss->Add(cds); //cds was taken out of its record with detachExon()
+	 segMaxLen(*cdss, cds->len());
 	 if (CDstart==0 || CDstart>cds->start) CDstart=cds->start;
 }
 
+GffExon* GffObj::detachExon(int i, GList<GffExon>* segs) {
+	if (segs==NULL) segs=&exons;
+	GffExon* ex=segs->Get(i);
+	segs->Forget(i);
+	if (ex==NULL || !ex->packed) return ex;
+	GffExon* r=new GffExon(*ex); //the copy takes its own reference to attrs
+	ex->~GffExon(); //its slot stays in exblock
+	return r;
+}
+
 int GffObj::addExon(uint segstart, uint segend, int8_t exontype, char phase, GffScore exon_score, GList<GffExon>* segs) {
    if (segstart>segend) { Gswap(segstart, segend); }
    if (segs==NULL) segs=&exons;
@@ -1001,6 +1224,7 @@ int GffObj::addExon(uint segstart, uint segend, int8_t exontype, char phase, Gff
      hasErrors(true);
      return -1;
    }
+   if (flag_SEG_BOUNDS) segMaxLen(*segs, enew->len());
    if (start>segs->First()->start) start=segs->First()->start;
    if (end<segs->Last()->end) end=segs->Last()->end;
    if (isFinalized() && segs==&exons) {
@@ -1041,6 +1265,7 @@ void GffObj::expandSegment(GList<GffExon>& segs, int oi, uint segstart, uint seg
          segs.Delete(ni);
       } else ++ni;
   } //until no more overlapping/adjacent segments found
+  if (flag_SEG_BOUNDS) segMaxLen(segs, segs[oi]->len());
   // -- make sure any other related boundaries are updated:
   if (isFinalized()) {
 	  if (&segs==&exons) {
@@ -1095,6 +1320,12 @@ GffObj::GffObj(GffReader& gfrd, BEDLine& bedline):GSeg(0,0),
 	parent=NULL;
 	udata=0;
 	flags=0;
+	flag_SEG_BOUNDS=true;
+	exblock=NULL;
+	rawattrs=NULL;
+	rawattrs_len=0;
+	exons_maxlen=0;
+	cdss_maxlen=0;
 	CDstart=0;
 	CDend=0;
 	CDphase=0;
@@ -1105,9 +1336,11 @@ GffObj::GffObj(GffReader& gfrd, BEDLine& bedline):GSeg(0,0),
 	//ftype_id=-1;
 	//subftype_id=-1;
 	strand='.';
+	names=gfrd.names;
 	gffnames_ref(names);
 	//qlen=0;qstart=0;qend=0;
 	covlen=0;
+	numrow=-1;
 	geneID=NULL;
 	gene_name=NULL;
 	ftype_id=gff_fid_transcript;
@@ -1134,16 +1367,35 @@ GffObj::GffObj(GffReader& gfrd, BEDLine& bedline):GSeg(0,0),
 		if (CDstart>0 && bedline.cds_phase)
 			CDphase=bedline.cds_phase;
 	}
-	if (gfrd.keep_Attrs && bedline.info!=NULL) this->parseAttrs(attrs, bedline.info);
+	if (gfrd.keep_Attrs && bedline.info!=NULL) {
+		this->parseAttrs(attrs, bedline.info);
+		if (gfrd.attr_Filter && attrs!=NULL) {
+			for (int i=0;i<attrs->Count();i++) {
+				const char* aname=names->attrs.getName(attrs->Get(i)->attr_id);
+				if (!gfrd.keepAttr(aname, strlen(aname))) attrs->freeItem(i);
+			}
+			attrs->Pack();
+			if (attrs->Count()==0) { delete attrs; attrs=NULL; }
+		}
+	}
+	if (gfrd.num_Attrs) gfrd.numAttrsFromStrings(this);
 }
 
-GffObj::GffObj(GffReader &gfrd, GffLine& gffline):
+GffObj::GffObj(GffReader &gfrd, GffLine& gffline, bool geneDict):
      GSeg(0,0), exons(true,true,false), cdss(NULL), children(1,false), gscore() {
   uptr=NULL;
   ulink=NULL;
   parent=NULL;
   udata=0;
   flags=0;
+  flag_SEG_BOUNDS=true;
+  flag_LAZY_ATTRS=gfrd.lazy_Attrs;
+  flag_GENE_DICT=geneDict;
+  exblock=NULL;
+  rawattrs=NULL;
+  rawattrs_len=0;
+  exons_maxlen=0;
+  cdss_maxlen=0;
   CDstart=0;
   CDend=0;
   CDphase=0;
@@ -1156,9 +1408,11 @@ GffObj::GffObj(GffReader &gfrd, GffLine& gffline):
   //ftype_id=-1;
   subftype_id=-1;
   strand='.';
+  names=gfrd.names;
   gffnames_ref(names);
   //qlen=0;qstart=0;qend=0;
   covlen=0;
+  numrow=-1;
   ftype_id=gffline.ftype_id;
   start=gffline.fstart;
   end=gffline.fend;
@@ -1198,7 +1452,8 @@ GffObj::GffObj(GffReader &gfrd, GffLine& gffline):
        if (gffline.ID!=NULL) { //unrecognized non-exon feature ? use the ID instead
             this->hasGffID(true);
             gffID=Gstrdup(gffline.ID);
-            if (gfrd.keep_Attrs) this->parseAttrs(attrs, gffline.info);
+            if (gfrd.keep_Attrs) this->parseAttrs(attrs, gffline);
+            if (gfrd.num_Attrs) gfrd.noteNumAttrs(this, gffline, false);
        }
        else { //no ID, just Parent
            GMessage("Warning: unrecognized parented feature without ID found before its parent:\n%s\n", gffline.dupline);
@@ -1252,7 +1507,8 @@ GffObj::GffObj(GffReader &gfrd, GffLine& gffline):
 		  }
       }
     } //is_transcript
-    if (gfrd.keep_Attrs) this->parseAttrs(attrs, gffline.info);
+    if (gfrd.keep_Attrs) this->parseAttrs(attrs, gffline);
+    if (gfrd.num_Attrs) gfrd.noteNumAttrs(this, gffline, false);
     if (gfrd.is_gff3 && gffline.parents==NULL && gffline.exontype!=exgffNone) {
        //special case with bacterial genes just given as a CDS/exon, without parent!
        this->createdByExon(true);
@@ -1264,10 +1520,10 @@ GffObj::GffObj(GffReader &gfrd, GffLine& gffline):
   }//no parent OR recognizable transcript
 
   if (gffline.gene_name!=NULL) {
-     gene_name=Gstrdup(gffline.gene_name);
+     setGeneName(gffline.gene_name);
      }
   if (gffline.gene_id) { //only for gene features or GTF2 gene_id attribute
-     geneID=Gstrdup(gffline.gene_id);
+     setGeneID(gffline.gene_id);
   }
   /*//we cannot assume parents[0] is a gene! for NCBI miRNA, parent can be a primary_transcript feature!
   else if (gffline.is_transcript && gffline.parents!=NULL) {
@@ -1280,8 +1536,7 @@ BEDLine* GffReader::nextBEDLine() {
  if (bedline!=NULL) return bedline; //caller should free gffline after processing
  while (bedline==NULL) {
 	int llen=0;
-	buflen=GFF_LINELEN-1;
-	char* l=fgetline(linebuf, buflen, fh, &fpos, &llen);
+	char* l=linereader.getLine(&llen);
 	if (l==NULL) return NULL;
 	int ns=0; //first nonspace position
 	while (l[ns]!=0 && isspace(l[ns])) ns++;
@@ -1299,15 +1554,20 @@ BEDLine* GffReader::nextBEDLine() {
 
 GffLine* GffReader::nextGffLine() {
  if (gffline!=NULL) return gffline; //caller should free gffline after processing
+ if (readGffLine()!=NULL) noteGffLine(gffline);
+ return gffline;
+}
+
+GffLine* GffReader::readGffLine() {
+ if (gffline!=NULL) return gffline;
  while (gffline==NULL) {
     int llen=0;
-    buflen=GFF_LINELEN-1;
-    char* l=fgetline(linebuf, buflen, fh, &fpos, &llen);
+    char* l=linereader.getLine(&llen);
     if (l==NULL) {
          return NULL; //end of file
          }
 #ifdef CUFFLINKS
-     _crc_result.process_bytes( linebuf, llen );
+     _crc_result.process_bytes( l, llen );
 #endif
     int ns=0; //first nonspace position
     bool commentLine=false;
@@ -1315,29 +1575,140 @@ GffLine* GffReader::nextGffLine() {
     if (l[ns]=='#') {
     	commentLine=true;
     	if (llen<10) {
-    		if (commentParser!=NULL) (*commentParser)(l, &gflst);
+    		if (commentParser!=NULL) parseComment(l);
     		continue;
     	}
     }
-    gffline=new GffLine(this, l);
+    lnarena.reset(); //the previous line's memory is recycled here
+    gffline=new (lnarena.alloc(sizeof(GffLine))) GffLine(this, l, llen, &lnarena);
     if (gffline->skipLine) {
-       if (commentLine && commentParser!=NULL) (*commentParser)(gffline->dupline, &gflst);
-       delete gffline;
-       gffline=NULL;
+       if (commentLine && commentParser!=NULL) parseComment(gffline->dupline);
+       deleteGffLine();
        continue;
     }
     if (gffline->ID==NULL && gffline->parents==NULL)  { //it must have an ID
         //this might not be needed, already checked in the GffLine constructor
         if (gff_warns)
             GMessage("Warning: malformed GFF line, no parent or record Id (kipping\n");
-        delete gffline;
-        gffline=NULL;
+        deleteGffLine();
         //continue;
         }
     }
 return gffline;
 }
 
+void GffReader::filterAttrs(const char* attrlist, bool exclude) {
+	attrFilter.Clear();
+	attr_Filter=false;
+	attr_Exclude=exclude;
+	if (attrlist==NULL) return;
+	const char* p=attrlist;
+	while (*p!=0) {
+		while (*p!=0 && strchr(",; \t", *p)!=NULL) p++;
+		const char* e=p;
+		while (*e!=0 && strchr(",; \t", *e)==NULL) e++;
+		if (e>p) {
+			char* aname=Gstrdup(p, e-1);
+			attrFilter.Add(aname);
+			GFREE(aname);
+		}
+		p=e;
+	}
+	attr_Filter=(attrFilter.Count()>0);
+}
+
+void GffReader::numericAttrs(const char* attrlist) {
+	numAttrCols.Clear();
+	numCols.Clear();
+	numRows=0;
+	num_Attrs=false;
+	if (attrlist==NULL) return;
+	const char* p=attrlist;
+	while (*p!=0) {
+		while (*p!=0 && strchr(",; \t", *p)!=NULL) p++;
+		const char* e=p;
+		while (*e!=0 && strchr(",; \t", *e)==NULL) e++;
+		if (e>p) {
+			char* aname=Gstrdup(p, e-1);
+			if (numAttrCols.Find(aname)==NULL) {
+				numAttrCols.Add(aname, new int(numCols.Count()));
+				numCols.Add(new GffNumColumn(aname));
+			}
+			GFREE(aname);
+		}
+		p=e;
+	}
+	num_Attrs=(numCols.Count()>0);
+}
+
+//numeric value of an attribute (quotes allowed), NAN if it does not start with a number
+static double gffNumValue(const char* v) {
+	if (v==NULL) return NAN;
+	while (*v==' ' || *v=='"') v++;
+	char* e=NULL;
+	double r=strtod(v, &e);
+	return (e==v) ? NAN : r;
+}
+
+int GffReader::addNumRow(GffObj* gfo) {
+	GArenaScope noarena(NULL); //the columns belong to the reader, not to the records
+	gfo->numrow=numRows++;
+	for (int c=0;c<numCols.Count();c++) numCols[c]->values.cAdd(NAN);
+	return gfo->numrow;
+}
+
+void GffReader::clearNumRows() {
+	for (int c=0;c<numCols.Count();c++) numCols[c]->values.setCount(0);
+	numRows=0;
+}
+
+void GffReader::noteNumAttrs(GffObj* gfo, GffLine& gl, bool exonline) {
+	for (int i=0;i<gl.numAttrToks;i++) {
+		GffAttrTok& t=gl.attrToks[i];
+		if (t.numcol<0) continue;
+		double v=gffNumValue(gl.line+t.val);
+		if (std::isnan(v)) continue;
+		if (gfo->numrow<0) addNumRow(gfo);
+		double& cv=numCols[t.numcol]->values[gfo->numrow];
+		if (!exonline || std::isnan(cv)) cv=v; //an exon/CDS value does not replace the record's
+	}
+}
+
+void GffReader::numAttrsFromStrings(GffObj* gfo) {
+	for (int c=0;c<numCols.Count();c++) {
+		double v=gffNumValue(gfo->getAttr(numCols[c]->name));
+		if (std::isnan(v)) continue;
+		if (gfo->numrow<0) addNumRow(gfo);
+		numCols[c]->values[gfo->numrow]=v;
+	}
+}
+
+void GffReader::renumberNumRows() {
+	GArenaScope noarena(NULL);
+	int n=gflst.Count();
+	for (int c=0;c<numCols.Count();c++) {
+		GVec<double> v(n>0 ? n : 1);
+		for (int i=0;i<n;i++) {
+			int r=gflst[i]->numrow;
+			v.cAdd(r<0 ? NAN : numCols[c]->values[r]);
+		}
+		numCols[c]->values=v;
+	}
+	for (int i=0;i<n;i++) gflst[i]->numrow=i;
+	numRows=n;
+}
+
+void GffReader::noteGffLine(GffLine* gl) {
+ //GffLine parsing leaves the shared state alone (once the input format is known),
+ //so it can run ahead of the records being built
+ if (gl->is_rna && gl->ftype_id<0)
+	 gl->ftype_id=names->feats.addName(gl->ftype);
+ if (gff_type!=0 && !is_gff3) {
+	 if (gl->is_gene) gtf_gene=true;
+	 if (gl->is_gtf_transcript) gtf_transcript=true;
+ }
+}
+
 
 char* GffReader::gfoBuildId(const char* id, const char* ctg) {
 //caller must free the returned pointer
@@ -1351,60 +1722,146 @@ char* GffReader::gfoBuildId(const char* id, const char* ctg) {
 }
 
 GffObj* GffReader::gfoAdd(GffObj* gfo) {
- GPVec<GffObj>* glst=phash.Find(gfo->gffID);
- if (glst==NULL)
-	 glst=new GPVec<GffObj>(false);
+ GArenaScope noarena(NULL); //the ID lists belong to the reader, not to the records
+ GffIdList* glst=NULL;
+ if (!pFind(gfo->gffID, glst)) {
+	 glst=new GffIdList();
+	 phash.Add(gfo->gffID, glst);
+	 pcache.add(phash.getLastKey(), glst);
+ }
  int i=glst->Add(gfo);
- phash.Add(gfo->gffID, glst);
  return glst->Get(i);
 }
 
-GffObj* GffReader::gfoAdd(GPVec<GffObj>& glst, GffObj* gfo) {
+GffObj* GffReader::gfoAdd(GffIdList& glst, GffObj* gfo) {
+ GArenaScope noarena(NULL);
  int i=glst.Add(gfo);
  return glst[i];
 }
 
-GffObj* GffReader::gfoReplace(GPVec<GffObj>& glst, GffObj* gfo, GffObj* toreplace) {
+GffObj* GffReader::gfoReplace(GffIdList& glst, GffObj* gfo, GffObj* toreplace) {
  for (int i=0;i<glst.Count();++i) {
 	 if (glst[i]==toreplace) {
 		 //glst.Put(i,gfo);
 		 glst[i]=gfo;
+		 glst.recIndexChanged(i);
 		 break;
 	 }
  }
  return gfo;
 }
 
-bool GffReader::pFind(const char* id, GPVec<GffObj>*& glst) {
-	glst = phash.Find(id);
+bool GffReader::pFind(const char* id, GffIdList*& glst) {
+	glst=pcache.find(id);
+	if (glst!=NULL) return true;
+	char* key=NULL;
+	glst = phash.Find(id, &key);
+	if (glst!=NULL) pcache.add(key, glst);
 	return (glst!=NULL);
 }
 
-GffObj* GffReader::gfoFind(const char* id, GPVec<GffObj>*& glst,
-		const char* ctg, char strand, uint start, uint end) {
-	GPVec<GffObj>* gl=NULL;
-	if (glst) {
-		gl=glst;
-	} else {
-		gl = phash.Find(id);
+//must be the same transcript, according to given comparison criteria
+static inline bool gfoAtLocus(GffObj& gfo, int gseq_id, char strand, uint start, uint end) {
+	if (gseq_id>=0 && gfo.gseq_id!=gseq_id) return false;
+	if (strand && gfo.strand!='.' && strand != gfo.strand) return false;
+	if (start>0) {
+		if (abs((int)start-(int)gfo.start)> (int)GFF_MAX_LOCUS) return false;
+		if (end>0 && (gfo.start>end || gfo.end<start)) return false;
 	}
-	GffObj* gh=NULL;
-	if (gl) {
-		for (int i=0;i<gl->Count();i++) {
-			GffObj& gfo = *(gl->Get(i));
-			if (ctg!=NULL && strcmp(ctg, gfo.getGSeqName())!=0)
-				continue;
-			if (strand && gfo.strand!='.' && strand != gfo.strand)
-				continue;
-			if (start>0) {
-				if (abs((int)start-(int)gfo.start)> (int)GFF_MAX_LOCUS)
-					continue;
-				if (end>0 && (gfo.start>end || gfo.end<start))
-					continue;
+	return true;
+}
+
+GffIdList::LocusBin* GffIdList::findBin(int gseq_id, int bin, int* ins) {
+	int l=0, r=bins->Count()-1;
+	while (l<=r) {
+		int m=(l+r)>>1;
+		LocusBin* b=bins->Get(m);
+		int c=(b->gseq_id!=gseq_id) ? b->gseq_id-gseq_id : b->bin-bin;
+		if (c==0) return b;
+		if (c<0) l=m+1;
+		else r=m-1;
+	}
+	if (ins) *ins=l;
+	return NULL;
+}
+
+void GffIdList::indexRec(int i) {
+	GArenaScope noarena(NULL);
+	GffObj* gfo=Get(i);
+	int bin=gfo->start/GFF_MAX_LOCUS;
+	int ins=0;
+	LocusBin* b=findBin(gfo->gseq_id, bin, &ins);
+	if (b==NULL) {
+		b=new LocusBin(gfo->gseq_id, bin);
+		bins->Insert(ins, b);
+	}
+	int n=b->recs.Count();
+	if (n==0 || b->recs.Last()<i) b->recs.Add(i);
+	else { //re-indexed entry (replaced record)
+		int p=0;
+		while (p<n && b->recs[p]<i) p++;
+		if (p==n || b->recs[p]!=i) b->recs.Insert(p, i);
+	}
+}
+
+void GffIdList::recStartChanged(GffObj* gfo, uint ostart) {
+	if (bins==NULL || ostart/GFF_MAX_LOCUS==gfo->start/GFF_MAX_LOCUS) return;
+	LocusBin* b=findBin(gfo->gseq_id, ostart/GFF_MAX_LOCUS);
+	if (b==NULL) return; //not indexed yet
+	for (int k=0;k<b->recs.Count();k++) {
+		int i=b->recs[k];
+		if (Get(i)!=gfo) continue;
+		b->recs.Delete(k);
+		indexRec(i);
+		return;
+	}
+}
+
+GffObj* GffIdList::findLocus(int gseq_id, char strand, uint start, uint end) {
+	if (bins==NULL) {
+		if (Count()<=GFF_IDLIST_MININDEX || gseq_id<0 || start==0) {
+			for (int i=0;i<Count();i++)
+				if (gfoAtLocus(*Get(i), gseq_id, strand, start, end)) return Get(i);
+			return NULL;
+		}
+		GArenaScope noarena(NULL);
+		bins=new GPVec<LocusBin>(8, true);
+	}
+	while (nindexed<Count()) indexRec(nindexed++);
+	//a record within GFF_MAX_LOCUS of start is in the start bin or in the ones next to it
+	//(the reader re-bins a record when its start changes, see recStartChanged())
+	int sbin=start/GFF_MAX_LOCUS;
+	int best=-1;
+	for (int bin=sbin-1;bin<=sbin+1;bin++) {
+		if (bin<0) continue;
+		LocusBin* b=findBin(gseq_id, bin);
+		if (b==NULL) continue;
+		for (int k=0;k<b->recs.Count();k++) {
+			int i=b->recs[k];
+			if (best>=0 && i>=best) break;
+			if (gfoAtLocus(*Get(i), gseq_id, strand, start, end)) {
+				best=i;
+				break;
 			}
-			//must be the same transcript, according to given comparison criteria
-			gh=&gfo;
-			break;
+		}
+	}
+	return (best<0) ? NULL : Get(best);
+}
+
+GffObj* GffReader::gfoFind(const char* id, GffIdList*& glst,
+		const char* ctg, char strand, uint start, uint end) {
+	GffIdList* gl=NULL;
+	if (glst) gl=glst;
+	else pFind(id, gl);
+	GffObj* gh=NULL;
+	if (gl && gl->Count()>0) {
+		if (ctg==NULL) {
+			for (int i=0;i<gl->Count() && gh==NULL;i++)
+				if (gfoAtLocus(*(gl->Get(i)), -1, strand, start, end)) gh=gl->Get(i);
+		}
+		else {
+			int gseq_id=names->gseqs.getId(ctg);
+			if (gseq_id>=0) gh=gl->findLocus(gseq_id, strand, start, end);
 		}
 	}
 	if (!glst) glst=gl;
@@ -1419,24 +1876,27 @@ GffObj* GffReader::updateParent(GffObj* newgfo, GffObj* parent) {
   newgfo->setLevel(parent->getLevel()+1);
   //if (parent->isGene()) {
   if (parent->gene_name!=NULL && newgfo->gene_name==NULL)
-      newgfo->gene_name=Gstrdup(parent->gene_name);
+      newgfo->setGeneName(parent->gene_name);
   if (parent->geneID!=NULL && newgfo->geneID==NULL)
-      newgfo->geneID=Gstrdup(parent->geneID);
+      newgfo->setGeneID(parent->geneID);
   //}
 
   return newgfo;
 }
 
-GffObj* GffReader::newGffRec(GffLine* gffline, GffObj* parent, GffExon* pexon, GPVec<GffObj>* glst, bool replace_parent) {
-  GffObj* newgfo=new GffObj(*this, *gffline);
+GffObj* GffReader::newGffRec(GffLine* gffline, GffObj* parent, GffExon* pexon, GffIdList* glst, bool replace_parent) {
+  GffObj* newgfo=new GffObj(*this, *gffline, true);
   GffObj* r=NULL;
-  gflst.Add(newgfo);
-  //tag non-transcripts to be discarded later
-  if (this->transcripts_Only && this->is_gff3 && gffline->ID!=NULL &&
-		  gffline->exontype==exgffNone && !gffline->is_gene && !gffline->is_transcript) {
-	  //unrecognized non-exon entity, should be discarded
-	  newgfo->isDiscarded(true);
-	  this->discarded_ids.Add(gffline->ID, new int(1));
+  {
+	GArenaScope noarena(NULL); //reader containers are kept out of the records' arena
+	gflst.Add(newgfo);
+	//tag non-transcripts to be discarded later
+	if (this->transcripts_Only && this->is_gff3 && gffline->ID!=NULL &&
+			gffline->exontype==exgffNone && !gffline->is_gene && !gffline->is_transcript) {
+		//unrecognized non-exon entity, should be discarded
+		newgfo->isDiscarded(true);
+		this->discarded_ids.Add(gffline->ID, new int(1));
+	}
   }
   if (replace_parent && glst) {
 	r=gfoReplace(*glst, newgfo, parent);
@@ -1451,10 +1911,13 @@ GffObj* GffReader::newGffRec(GffLine* gffline, GffObj* parent, GffExon* pexon, G
   return r;
 }
 
-GffObj* GffReader::newGffRec(BEDLine* bedline, GPVec<GffObj>* glst) {
+GffObj* GffReader::newGffRec(BEDLine* bedline, GffIdList* glst) {
   GffObj* newgfo=new GffObj(*this, *bedline);
   GffObj* r=NULL;
-  gflst.Add(newgfo);
+  {
+	GArenaScope noarena(NULL);
+	gflst.Add(newgfo);
+  }
   r=(glst) ? gfoAdd(*glst, newgfo) : gfoAdd(newgfo);
   return r;
 }
@@ -1472,8 +1935,13 @@ GffObj* GffReader::updateGffRec(GffObj* prevgfo, GffLine* gffline) {
  prevgfo->isTranscript(gffline->is_transcript || gffline->exontype!=exgffNone);
  prevgfo->hasGffID(gffline->ID!=NULL);
  if (keep_Attrs) {
-   if (prevgfo->attrs!=NULL) prevgfo->attrs->Clear();
-   prevgfo->parseAttrs(prevgfo->attrs, gffline->info);
+   prevgfo->clearAttrs();
+   prevgfo->parseAttrs(prevgfo->attrs, *gffline);
+   }
+ if (num_Attrs) {
+   if (prevgfo->numrow>=0) //the values of the replaced line are dropped too
+     for (int c=0;c<numCols.Count();c++) numCols[c]->values[prevgfo->numrow]=NAN;
+   noteNumAttrs(prevgfo, *gffline, false);
    }
  return prevgfo;
 }
@@ -1529,8 +1997,9 @@ CNonExon* GffReader::subfPoolCheck(GffLine* gffline, GHash<CNonExon>& pex, char*
 void GffReader::subfPoolAdd(GHash<CNonExon>& pex, GffObj* newgfo) {
 //this might become a parent feature later
 if (newgfo->exons.Count()>0) {
+   GArenaScope noarena(NULL);
    char* xbuf=gfoBuildId(gffline->ID, gffline->gseqname);
-   pex.Add(xbuf, new CNonExon(newgfo, newgfo->exons[0], *gffline));
+   pex.Add(xbuf, new CNonExon(newgfo, newgfo->exons[0], *gffline, &pexarena));
    GFREE(xbuf);
    }
 }
@@ -1546,9 +2015,173 @@ GffObj* GffReader::promoteFeature(CNonExon* subp, char*& subp_name, GHash<CNonEx
   return gfoh; //returns the holder of newly promoted feature
 }
 
+//the input lines of one record, as grouped by the readNext() pipeline thread
+class GffLineGroup {
+ public:
+	BEDLine* bedline;
+	GPVec<GffLine> lines; //copies of the record's lines
+	char* tid; //transcript ID of the record (in lines[0])
+	GVec<char*> comments; //comment lines read up to the record's last line, for the commentParser
+	GffLineGroup(BEDLine* bl=NULL):bedline(bl), lines(4, true), tid(NULL), comments(0) { }
+	~GffLineGroup() {
+		delete bedline;
+		for (int i=0;i<comments.Count();i++) GFREE(comments[i]);
+	}
+};
+
+//bounded queue between the readNext() pipeline thread and readNext()
+class GffReadAhead {
+	std::mutex mtx;
+	std::condition_variable notfull;
+	std::condition_variable notempty;
+	GPVec<GffLineGroup> queue;
+	int maxqueue;
+	bool done; //no more records (set by the pipeline thread)
+	bool stop; //the reader is being destroyed
+ public:
+	std::thread parser;
+	GVec<char*> comments; //pipeline thread only: comment lines not yet attached to a group
+	void takeComments(GffLineGroup* grp) {
+		for (int i=0;i<comments.Count();i++) grp->comments.Add(comments[i]);
+		comments.setCount(0);
+	}
+	GffReadAhead(int maxq):queue(maxq, true), maxqueue(maxq), done(false), stop(false), comments(0) { }
+	~GffReadAhead() { for (int i=0;i<comments.Count();i++) GFREE(comments[i]); }
+	bool push(GffLineGroup* grp) { //returns false if the pipeline is being stopped
+		std::unique_lock<std::mutex> lock(mtx);
+		while (!stop && queue.Count()>=maxqueue) notfull.wait(lock);
+		if (stop) { delete grp; return false; }
+		queue.Add(grp);
+		notempty.notify_one();
+		return true;
+	}
+	GffLineGroup* pop() { //returns NULL at the end of the input
+		std::unique_lock<std::mutex> lock(mtx);
+		while (!done && queue.Count()==0) notempty.wait(lock);
+		if (queue.Count()==0) return NULL;
+		GffLineGroup* grp=queue.Shift();
+		notfull.notify_one();
+		return grp;
+	}
+	void finish(bool stopping=false) {
+		std::lock_guard<std::mutex> lock(mtx);
+		if (stopping) stop=true;
+		else done=true;
+		notfull.notify_all();
+		notempty.notify_all();
+	}
+};
+
+void GffReader::parseComment(char* l) {
+	//the pipeline thread must not touch gflst, readAheadNext() passes the comments on
+	if (readahead!=NULL) {
+		char* cl=Gstrdup(l);
+		readahead->comments.Add(cl);
+	}
+	else (*commentParser)(l, &gflst);
+}
+
+void GffReader::startReadAhead(int maxqueue) {
+	if (readahead!=NULL) return;
+	//the input format is detected here, from the first line with an ID or parent (the
+	//lines before it are skipped anyway), so the pipeline thread leaves the flags alone;
+	//the line is picked up by the thread's first readGffLine()
+	if (!is_BED) readGffLine();
+	readahead=new GffReadAhead(GMAX(maxqueue, 1));
+	readahead->parser=std::thread(&GffReader::readAheadLines, this);
+}
+
+void GffReader::stopReadAhead() {
+	if (readahead==NULL) return;
+	readahead->finish(true);
+	readahead->parser.join();
+	delete readahead;
+	readahead=NULL;
+}
+
+void GffReader::readAheadLines() {
+	//same record grouping as readNext(), but the GffObj are built by readNext()
+	if (is_BED) {
+		while (nextBEDLine()) {
+			GffLineGroup* grp=new GffLineGroup(bedline);
+			bedline=NULL;
+			if (!readahead->push(grp)) return;
+		}
+	}
+	else {
+		GffLineGroup* grp=NULL;
+		//noteGffLine() is left to readNext(), this thread does not touch the names
+		while (readGffLine()!=NULL) {
+			char* tid=gffline->ID;
+			if (gffline->is_exon) tid=gffline->parents[0];
+			else if (!(gffline->is_transcript || gffline->is_gene))
+				tid=NULL; //only transcript && gene records
+			if (tid==NULL) {
+				deleteGffLine();
+				continue;
+			}
+			if (grp!=NULL && strcmp(grp->tid, tid)==0) {
+				if (!gffline->is_exon) {
+					GMessage("Warning: skipping unexpected non-exon record with previously seen ID:\n%s\n", gffline->dupline);
+					deleteGffLine();
+					continue;
+				}
+				readahead->takeComments(grp);
+				grp->lines.Add(new GffLine(*gffline));
+			}
+			else { //new transcript
+				if (grp!=NULL && !readahead->push(grp)) {
+					deleteGffLine();
+					return;
+				}
+				grp=new GffLineGroup();
+				readahead->takeComments(grp);
+				GffLine* gl=new GffLine(*gffline);
+				grp->lines.Add(gl);
+				grp->tid=gl->is_exon ? gl->parents[0] : gl->ID;
+			}
+			deleteGffLine();
+		}
+		//trailing comments are passed on before the last record, as readNext() would do,
+		//or in a group without lines if there is no record
+		if (grp==NULL && readahead->comments.Count()>0) grp=new GffLineGroup();
+		if (grp!=NULL) {
+			readahead->takeComments(grp);
+			if (!readahead->push(grp)) return;
+		}
+	}
+	readahead->finish();
+}
+
+GffObj* GffReader::readAheadNext() {
+	GffLineGroup* grp=readahead->pop();
+	if (grp==NULL) return NULL;
+	for (int i=0;i<grp->comments.Count();i++)
+		(*commentParser)(grp->comments[i], &gflst);
+	if (grp->bedline==NULL && grp->lines.Count()==0) { //only comments, no records
+		delete grp;
+		return NULL;
+	}
+	GffObj* gfo=NULL;
+	if (grp->bedline!=NULL) gfo=new GffObj(*this, *grp->bedline);
+	else {
+		for (int i=0;i<grp->lines.Count();i++) {
+			GffLine* gl=grp->lines[i];
+			noteGffLine(gl);
+			if (i==0) gfo=new GffObj(*this, *gl);
+			else readExonFeature(gfo, gl); //also takes care of adding CDS segments
+		}
+	}
+	delete grp;
+	gfo->finalize(this);
+	return gfo;
+}
+
 //In the rare cases where the GFF/GTF stream is properly formatted
 // i.e. when all sub-features are grouped with (and preceded by) their parent!
 GffObj* GffReader::readNext() { //user must free the returned GffObj*
+ if (num_Attrs) clearNumRows(); //the previous record was handed off
+ if (readahead!=NULL) return readAheadNext();
  GffObj* gfo=NULL;
  //GSeg tseg(0,0); //transcript boundaries
  char* lastID=NULL;
@@ -1569,8 +2202,7 @@ GffObj* GffReader::readNext() { //user must free the returned GffObj*
     			tid=NULL; //WARNING: only parsing transcript && gene records here
     	//if (tid==NULL || gffline->num_parents>1) {
     	if (tid==NULL) { //not a suitable transcript ID found, skip this line
-    		delete gffline;
-    		gffline=NULL;
+    		deleteGffLine();
     		continue;
     	}
     	bool sameID=(lastID!=NULL && strcmp(lastID, tid)==0);
@@ -1579,8 +2211,7 @@ GffObj* GffReader::readNext() { //user must free the returned GffObj*
     		//TODO: if gffline->is_transcript: trans-splicing!
     		if (!gffline->is_exon) {
     			GMessage("Warning: skipping unexpected non-exon record with previously seen ID:\n%s\n", gffline->dupline);
-    			delete gffline;
-    			gffline=NULL;
+    			deleteGffLine();
     			continue;
     		}
     		readExonFeature(gfo, gffline); //also takes care of adding CDS segments
@@ -1603,8 +2234,7 @@ GffObj* GffReader::readNext() { //user must free the returned GffObj*
     		}
     	} //transcript ID change
     	//gffline processed, move on
-		delete gffline;
-		gffline=NULL;
+		deleteGffLine();
     } //while nextgffline()
  } //GFF records
  GFREE(lastID);
@@ -1621,224 +2251,1046 @@ GffObj* GffReader::readNext() { //user must free the returned GffObj*
 //with the same ID but NOT overlapping/continuous
 //  *** BUT (exception): proximal xRNA features with the same ID, on the same strand, will be merged
 //  and the segments will be treated like exons (e.g. TRNAR15 (rna1940) in RefSeq)
+void GffReader::reserveIds() {
+	//phash only takes the parent records (transcripts, genes), each followed by its
+	//exon/CDS lines: about 2K of GFF/GTF input per parent (and ~6x that when compressed);
+	//the estimate is capped, as growing phash later does not rehash the keys
+	struct stat st;
+	if (fh==NULL || phash.Count()>0 || fstat(fileno(fh), &st)!=0 || st.st_size<=0) return;
+	GArenaScope noarena(NULL);
+	int64 nrecs=st.st_size>>11;
+	if (gzreader!=NULL) nrecs*=6;
+	phash.reserve((int)GMIN(nrecs, (int64)GFF_MAX_RESERVE_IDS));
+}
+
 void GffReader::readAll() {
 	bool validation_errors = false;
+	GArenaScope ascope(use_Arena ? &objarena : GArena::active());
+	if (!is_BED) reserveIds();
 	if (is_BED) {
-		while (nextBEDLine()) {
-			GPVec<GffObj>* prevgflst=NULL;
-			GffObj* prevseen=gfoFind(bedline->ID, prevgflst, bedline->gseqname, bedline->strand, bedline->fstart);
-			if (prevseen) {
-			//duplicate ID -- but this could also be a discontinuous feature according to GFF3 specs
-			  //e.g. a trans-spliced transcript - but segments should not overlap
-				if (prevseen->overlap(bedline->fstart, bedline->fend)) {
+		while (nextBEDLine())
+			processBEDLine();
+	}
+	else { //regular GFF/GTF or perhaps TLF?
+		//loc_debug=false;
+		GHash<CNonExon> pex; //keep track of any parented (i.e. exon-like) features that have an ID
+		//and thus could become promoted to parent features
+		while (nextGffLine()!=NULL) {
+			processGffLine(pex, validation_errors);
+			deleteGffLine();
+		}
+	}
+	readAllDone(validation_errors);
+}
+
+void GffReader::processBEDLine() {
+	GffIdList* prevgflst=NULL;
+	GffObj* prevseen=gfoFind(bedline->ID, prevgflst, bedline->gseqname, bedline->strand, bedline->fstart);
+	if (prevseen) {
+	//duplicate ID -- but this could also be a discontinuous feature according to GFF3 specs
+	  //e.g. a trans-spliced transcript - but segments should not overlap
+		if (prevseen->overlap(bedline->fstart, bedline->fend)) {
+			//overlapping feature with same ID is going too far
+			GMessage("Error: overlapping duplicate BED feature (ID=%s)\n", bedline->ID);
+			//validation_errors = true;
+			if (gff_warns) { //validation intent: just skip the feature, allow the user to see other errors
+				delete bedline;
+				bedline=NULL;
+				return;
+			}
+			else exit(1);
+		}
+		//create a separate entry (true discontinuous feature?)
+		prevseen=newGffRec(bedline, prevgflst);
+		if (gff_warns) {
+			GMessage("Warning: duplicate BED feature ID %s (%d-%d) (discontinuous feature?)\n",
+					bedline->ID, bedline->fstart, bedline->fend);
+		}
+	}
+	else {
+		newGffRec(bedline, prevgflst);
+	}
+	delete bedline;
+	bedline=NULL;
+}
+
+bool GffReader::processCleanGffLine(GHash<CNonExon>& pex, bool& validation_errors) {
+	//a new (uniquely identified) parent-like feature, or an exon-like feature
+	//of a transcript seen before; anything else is left to the general path
+	if (gffline->num_parents>1) return false;
+	if (gffline->parents!=NULL && discarded_ids.Count()>0 &&
+			discarded_ids.Find(gffline->parents[0])!=NULL) return false;
+	GffIdList* plst=NULL;
+	if (gffline->exontype==exgffNone) {
+		if (gffline->ID==NULL) return false;
+		GffIdList* idlst=NULL;
+		if (gfoFind(gffline->ID, idlst, gffline->gseqname, gffline->strand, gffline->fstart)!=NULL)
+			return false; //duplicate ID, or its exons were seen first
+		if (gffline->parents==NULL) {
+			newGffRec(gffline, NULL, NULL, idlst);
+			return true;
+		}
+		if (!pFind(gffline->parents[0], plst) || plst->Count()==0) return false;
+		GffObj* parentgfo=plst->Get(0);
+		if (!parentgfo->isGene() && !parentgfo->isTranscript()) return false;
+		newGffRec(gffline, parentgfo);
+		return true;
+	}
+	if (gffline->parents==NULL || gffline->is_transcript || gffline->exontype==exgffIntron)
+		return false;
+	if (!pFind(gffline->parents[0], plst)) return false;
+	GffObj* parentgfo=gfoFind(gffline->parents[0], plst, gffline->gseqname,
+			gffline->strand, gffline->fstart);
+	if (parentgfo==NULL) return false;
+	uint ostart=parentgfo->start;
+	if (!readExonFeature(parentgfo, gffline, &pex))
+		validation_errors=true;
+	if (parentgfo->start!=ostart) plst->recStartChanged(parentgfo, ostart);
+	return true;
+}
+
+void GffReader::processGffLine(GHash<CNonExon>& pex, bool& validation_errors) {
+	if (clean_Active) {
+		if (processCleanGffLine(pex, validation_errors)) return;
+		//unexpected input, the general path is used from now on
+		clean_Active=false;
+		if (gff_warns)
+			GMessage("Warning: clean annotation parsing disabled at %s feature %s (%s:%d-%d)\n",
+					gffline->ftype, gffline->ID ? gffline->ID : gffline->parents ? gffline->parents[0] : "",
+					gffline->gseqname, gffline->fstart, gffline->fend);
+	}
+	GffObj* prevseen=NULL;
+	GffIdList* prevgflst=NULL;
+	if (gffline->ID && gffline->exontype==exgffNone) {
+		//parent-like feature ID (mRNA, gene, etc.) not recognized as an exon feature
+		//check if this ID was previously seen on the same chromosome/strand within GFF_MAX_LOCUS distance
+		prevseen=gfoFind(gffline->ID, prevgflst, gffline->gseqname, gffline->strand, gffline->fstart);
+		if (prevseen) {
+			//same ID seen in the same locus/region
+			if (prevseen->createdByExon()) {
+				if (gff_warns && (prevseen->start<gffline->fstart ||
+						prevseen->end>gffline->fend))
+					GMessage("Warning: invalid coordinates for %s parent feature (ID=%s)\n", gffline->ftype, gffline->ID);
+				//an exon of this ID was given before
+				//this line has the main attributes for this ID
+				uint ostart=prevseen->start;
+				updateGffRec(prevseen, gffline);
+				if (prevseen->start!=ostart) prevgflst->recStartChanged(prevseen, ostart);
+			}
+			else { //possibly a duplicate ID -- but this could also be a discontinuous feature according to GFF3 specs
+			    //e.g. a trans-spliced transcript - though segments should not overlap!
+				bool gtf_gene_dupID=(prevseen->isGene() && gffline->is_gtf_transcript);
+				if (prevseen->overlap(gffline->fstart, gffline->fend) && !gtf_gene_dupID) {
+					//in some GTFs a gene ID may actually be the same with the parented transcript ID (thanks)
 					//overlapping feature with same ID is going too far
-					GMessage("Error: overlapping duplicate BED feature (ID=%s)\n", bedline->ID);
+					GMessage("Error: discarding overlapping duplicate %s feature (%d-%d) with ID=%s\n", gffline->ftype,
+							gffline->fstart, gffline->fend, gffline->ID);
 					//validation_errors = true;
 					if (gff_warns) { //validation intent: just skip the feature, allow the user to see other errors
-						delete bedline;
-						bedline=NULL;
-						continue;
+						return;
 					}
-					else exit(1);
+					//else exit(1);
+				}
+				if (gtf_gene_dupID) {
+					//special GTF case where parent gene_id matches transcript_id (sigh)
+					prevseen=newGffRec(gffline, prevseen, NULL, prevgflst, true);
 				}
-				//create a separate entry (true discontinuous feature?)
-				prevseen=newGffRec(bedline, prevgflst);
-				if (gff_warns) {
-					GMessage("Warning: duplicate BED feature ID %s (%d-%d) (discontinuous feature?)\n",
-							bedline->ID, bedline->fstart, bedline->fend);
+				else {
+					//create a separate entry (true discontinuous feature)
+					prevseen=newGffRec(gffline, prevseen->parent, NULL, prevgflst);
+					if (gff_warns) {
+						GMessage("Warning: duplicate feature ID %s (%d-%d) (discontinuous feature?)\n",
+								gffline->ID, gffline->fstart, gffline->fend);
+					}
 				}
+			} //duplicate ID in the same locus
+		} //ID seen previously in the same locus
+	} //parent-like ID feature (non-exon)
+	if (gffline->parents==NULL) {
+		//top level feature (transcript, gene), no parents (or parents can be ignored)
+		if (!prevseen) newGffRec(gffline, NULL, NULL, prevgflst);
+	}
+	else { //--- it's a child feature (exon/CDS or even a mRNA with a gene as parent)
+		//updates all the declared parents with this child
+		bool found_parent=false;
+		if (gffline->is_gtf_transcript && prevseen && prevseen->parent) {
+			found_parent=true; //parent already found in special GTF case
+		}
+		else {
+			GffObj* newgfo=prevseen;
+			GffIdList* newgflst=NULL;
+			GVec<int> kparents(0); //kept parents (non-discarded)
+			GVec<GffIdList*> kgflst(false);
+			GffIdList* gflst0=NULL;
+			{
+			GArenaScope noarena(NULL); //line scratch, not record data
+			for (int i=0;i<gffline->num_parents;i++) {
+				newgflst=NULL;
+				//if (transcriptsOnly && (
+				if (discarded_ids.Find(gffline->parents[i])!=NULL) continue;
+				if (!pFind(gffline->parents[i], newgflst))
+					continue; //skipping discarded parent feature
+				kparents.Add(i);
+				if (i==0) gflst0=newgflst;
+				kgflst.Add(newgflst);
 			}
-			else {
-				newGffRec(bedline, prevgflst);
+			if (gffline->num_parents>0 && kparents.Count()==0) {
+				kparents.cAdd(0);
+				kgflst.Add(gflst0);
 			}
-			delete bedline;
-			bedline=NULL;
-		}
-	}
-	else { //regular GFF/GTF or perhaps TLF?
-		//loc_debug=false;
-		GHash<CNonExon> pex; //keep track of any parented (i.e. exon-like) features that have an ID
-		//and thus could become promoted to parent features
-		while (nextGffLine()!=NULL) {
-			GffObj* prevseen=NULL;
-			GPVec<GffObj>* prevgflst=NULL;
-			if (gffline->ID && gffline->exontype==exgffNone) {
-				//parent-like feature ID (mRNA, gene, etc.) not recognized as an exon feature
-				//check if this ID was previously seen on the same chromosome/strand within GFF_MAX_LOCUS distance
-				prevseen=gfoFind(gffline->ID, prevgflst, gffline->gseqname, gffline->strand, gffline->fstart);
-				if (prevseen) {
-					//same ID seen in the same locus/region
-					if (prevseen->createdByExon()) {
-						if (gff_warns && (prevseen->start<gffline->fstart ||
-								prevseen->end>gffline->fend))
-							GMessage("Warning: invalid coordinates for %s parent feature (ID=%s)\n", gffline->ftype, gffline->ID);
-						//an exon of this ID was given before
-						//this line has the main attributes for this ID
-						updateGffRec(prevseen, gffline);
-					}
-					else { //possibly a duplicate ID -- but this could also be a discontinuous feature according to GFF3 specs
-					    //e.g. a trans-spliced transcript - though segments should not overlap!
-						bool gtf_gene_dupID=(prevseen->isGene() && gffline->is_gtf_transcript);
-						if (prevseen->overlap(gffline->fstart, gffline->fend) && !gtf_gene_dupID) {
-							//in some GTFs a gene ID may actually be the same with the parented transcript ID (thanks)
-							//overlapping feature with same ID is going too far
-							GMessage("Error: discarding overlapping duplicate %s feature (%d-%d) with ID=%s\n", gffline->ftype,
-									gffline->fstart, gffline->fend, gffline->ID);
-							//validation_errors = true;
-							if (gff_warns) { //validation intent: just skip the feature, allow the user to see other errors
-								delete gffline;
-								gffline=NULL;
-								continue;
-							}
-							//else exit(1);
-						}
-						if (gtf_gene_dupID) {
-							//special GTF case where parent gene_id matches transcript_id (sigh)
-							prevseen=newGffRec(gffline, prevseen, NULL, prevgflst, true);
-						}
-						else {
-							//create a separate entry (true discontinuous feature)
-							prevseen=newGffRec(gffline, prevseen->parent, NULL, prevgflst);
-							if (gff_warns) {
-								GMessage("Warning: duplicate feature ID %s (%d-%d) (discontinuous feature?)\n",
-										gffline->ID, gffline->fstart, gffline->fend);
-							}
-						}
-					} //duplicate ID in the same locus
-				} //ID seen previously in the same locus
-			} //parent-like ID feature (non-exon)
-			if (gffline->parents==NULL) {
-				//top level feature (transcript, gene), no parents (or parents can be ignored)
-				if (!prevseen) newGffRec(gffline, NULL, NULL, prevgflst);
 			}
-			else { //--- it's a child feature (exon/CDS or even a mRNA with a gene as parent)
-				//updates all the declared parents with this child
-				bool found_parent=false;
-				if (gffline->is_gtf_transcript && prevseen && prevseen->parent) {
-					found_parent=true; //parent already found in special GTF case
+			for (int k=0;k<kparents.Count();k++) {
+				int i=kparents[k];
+				newgflst=kgflst[k];
+				GffObj* parentgfo=NULL;
+				if (gffline->is_transcript || gffline->exontype==exgffNone) {//likely a transcript
+					//parentgfo=gfoFind(gffline->parents[i], newgflst, gffline->gseqname,
+					//		gffline->strand, gffline->fstart, gffline->fend);
+					if (newgflst!=NULL && newgflst->Count()>0)
+						parentgfo = newgflst->Get(0);
 				}
 				else {
-					GffObj* newgfo=prevseen;
-					GPVec<GffObj>* newgflst=NULL;
-					GVec<int> kparents; //kept parents (non-discarded)
-					GVec< GPVec<GffObj>* > kgflst(false);
-					GPVec<GffObj>* gflst0=NULL;
-					for (int i=0;i<gffline->num_parents;i++) {
-						newgflst=NULL;
-						//if (transcriptsOnly && (
-						if (discarded_ids.Find(gffline->parents[i])!=NULL) continue;
-						if (!pFind(gffline->parents[i], newgflst))
-							continue; //skipping discarded parent feature
-						kparents.Add(i);
-						if (i==0) gflst0=newgflst;
-						kgflst.Add(newgflst);
-					}
-					if (gffline->num_parents>0 && kparents.Count()==0) {
-						kparents.cAdd(0);
-						kgflst.Add(gflst0);
-					}
-					for (int k=0;k<kparents.Count();k++) {
-						int i=kparents[k];
-						newgflst=kgflst[k];
-						GffObj* parentgfo=NULL;
-						if (gffline->is_transcript || gffline->exontype==exgffNone) {//likely a transcript
-							//parentgfo=gfoFind(gffline->parents[i], newgflst, gffline->gseqname,
-							//		gffline->strand, gffline->fstart, gffline->fend);
-							if (newgflst!=NULL && newgflst->Count()>0)
-								parentgfo = newgflst->Get(0);
+					//for exon-like entities we only need a parent to be in locus distance,
+					//on the same strand
+					parentgfo=gfoFind(gffline->parents[i], newgflst, gffline->gseqname,
+							gffline->strand, gffline->fstart);
+				}
+				if (parentgfo!=NULL) { //parent GffObj parsed earlier
+					found_parent=true;
+					if ((parentgfo->isGene() || parentgfo->isTranscript()) && (gffline->is_transcript ||
+							 gffline->exontype==exgffNone)) {
+						//not an exon, but could be a transcript parented by a gene
+						// *or* by another transcript (! miRNA -> primary_transcript)
+						if (newgfo) {
+							updateParent(newgfo, parentgfo);
 						}
 						else {
-							//for exon-like entities we only need a parent to be in locus distance,
-							//on the same strand
-							parentgfo=gfoFind(gffline->parents[i], newgflst, gffline->gseqname,
-									gffline->strand, gffline->fstart);
+							newgfo=newGffRec(gffline, parentgfo);
 						}
-						if (parentgfo!=NULL) { //parent GffObj parsed earlier
-							found_parent=true;
-							if ((parentgfo->isGene() || parentgfo->isTranscript()) && (gffline->is_transcript ||
-									 gffline->exontype==exgffNone)) {
-								//not an exon, but could be a transcript parented by a gene
-								// *or* by another transcript (! miRNA -> primary_transcript)
-								if (newgfo) {
-									updateParent(newgfo, parentgfo);
-								}
-								else {
-									newgfo=newGffRec(gffline, parentgfo);
-								}
-							}
-							else { //potential exon subfeature?
-								bool addingExon=false;
-								if (transcripts_Only) {
-									if (gffline->exontype>0) addingExon=true;
-								}
-								else { //always discard silly "intron" features
-									if (! (gffline->exontype==exgffIntron && (parentgfo->isTranscript() || parentgfo->exons.Count()>0)))
-									  addingExon=true;
-								}
-								if (addingExon)
-									if (!readExonFeature(parentgfo, gffline, &pex))
-									   validation_errors=true;
-
-							}
-						} //overlapping parent feature found
-					} //for each parsed parent Id
-					if (!found_parent) { //new GTF-like record starting directly here as a subfeature
-						//or it could be some chado GFF3 barf with exons coming BEFORE their parent :(
-						//or it could also be a stray transcript without a parent gene defined previously
-						//check if this feature isn't parented by a previously stored "child" subfeature
-						char* subp_name=NULL;
-						CNonExon* subp=NULL;
-						if (!gffline->is_transcript) { //don't bother with this check for obvious transcripts
-							if (pex.Count()>0) subp=subfPoolCheck(gffline, pex, subp_name);
-							if (subp!=NULL) { //found a subfeature that is the parent of this (!)
-								//promote that subfeature to a full GffObj
-								GffObj* gfoh=promoteFeature(subp, subp_name, pex);
-								//add current gffline as an exon of the newly promoted subfeature
-								if (!readExonFeature(gfoh, gffline, &pex))
-									validation_errors=true;
-							}
+					}
+					else { //potential exon subfeature?
+						bool addingExon=false;
+						if (transcripts_Only) {
+							if (gffline->exontype>0) addingExon=true;
+						}
+						else { //always discard silly "intron" features
+							if (! (gffline->exontype==exgffIntron && (parentgfo->isTranscript() || parentgfo->exons.Count()>0)))
+							  addingExon=true;
 						}
-						if (subp==NULL) { //no parent subfeature seen before
-							//loc_debug=true;
-							GffObj* ngfo=prevseen;
-							if (ngfo==NULL) {
-								//if it's an exon type, create directly the parent with this exon
-								//but if it's recognized as a transcript, the object itself is created
-								ngfo=newGffRec(gffline, NULL, NULL, newgflst);
-							}
-							if (!ngfo->isTranscript() &&
-									gffline->ID!=NULL && gffline->exontype==0)
-								subfPoolAdd(pex, ngfo);
-							//even those with errors will be added here!
+						if (addingExon) {
+							uint ostart=parentgfo->start;
+							if (!readExonFeature(parentgfo, gffline, &pex))
+							   validation_errors=true;
+							if (parentgfo->start!=ostart) newgflst->recStartChanged(parentgfo, ostart);
 						}
-						GFREE(subp_name);
-					} //no previous parent found
+
+					}
+				} //overlapping parent feature found
+			} //for each parsed parent Id
+			if (!found_parent) { //new GTF-like record starting directly here as a subfeature
+				//or it could be some chado GFF3 barf with exons coming BEFORE their parent :(
+				//or it could also be a stray transcript without a parent gene defined previously
+				//check if this feature isn't parented by a previously stored "child" subfeature
+				char* subp_name=NULL;
+				CNonExon* subp=NULL;
+				if (!gffline->is_transcript) { //don't bother with this check for obvious transcripts
+					if (pex.Count()>0) subp=subfPoolCheck(gffline, pex, subp_name);
+					if (subp!=NULL) { //found a subfeature that is the parent of this (!)
+						//promote that subfeature to a full GffObj
+						GffObj* gfoh=promoteFeature(subp, subp_name, pex);
+						//add current gffline as an exon of the newly promoted subfeature
+						if (!readExonFeature(gfoh, gffline, &pex))
+							validation_errors=true;
+					}
+				}
+				if (subp==NULL) { //no parent subfeature seen before
+					//loc_debug=true;
+					GffObj* ngfo=prevseen;
+					if (ngfo==NULL) {
+						//if it's an exon type, create directly the parent with this exon
+						//but if it's recognized as a transcript, the object itself is created
+						ngfo=newGffRec(gffline, NULL, NULL, newgflst);
+					}
+					if (!ngfo->isTranscript() &&
+							gffline->ID!=NULL && gffline->exontype==0)
+						subfPoolAdd(pex, ngfo);
+					//even those with errors will be added here!
+				}
+				GFREE(subp_name);
+			} //no previous parent found
+		}
+	} //parented feature
+}
+
+//GffLines parsed by a readAll(nthreads) thread from its part of the input block
+struct GffLineRef {
+	GffLine* gffline;
+	char* comment; //for comment lines passed to the commentParser (gffline is NULL)
+};
+
+class GffLineBlock {
+ public:
+	GArena arena; //GffLine objects and their parsed fields, recycled for each input block
+	GDynArray<GffLineRef> lines; //in input order
+	GffLineBlock():arena(GARENA_BLOCKSIZE<<4), lines(1024) { }
+	void add(GffLine* gl, char* comment=NULL) {
+		GffLineRef r={gl, comment};
+		lines.Add(r);
+	}
+	void clear() {
+		lines.Reset();
+		arena.reset();
+	}
+};
+
+//returns the start of the line following the one that p is in
+static char* nextLineStart(char* p, char* dend) {
+	while (p<dend && *p!='\n' && *p!='\r') p++;
+	if (p<dend && *p=='\r' && p+1<dend && p[1]=='\n') p++;
+	return (p<dend) ? p+1 : dend;
+}
+
+void GffReader::parseGffBlock(char* data, int dlen, GffLineBlock& lblock) {
+	//same line handling as nextGffLine(), lines are terminated in place
+	char* p=data;
+	char* dend=data+dlen;
+	while (p<dend) {
+		char* eol=(char*)memchr(p, '\n', dend-p);
+		char* cr=(char*)memchr(p, '\r', (eol==NULL) ? dend-p : eol-p);
+		int eollen=1;
+		if (cr!=NULL) {
+			eol=cr;
+			if (cr+1<dend && cr[1]=='\n') eollen=2;
+		}
+		else if (eol==NULL) { //last line of the input, without a line ending
+			eol=dend;
+			eollen=0;
+		}
+		char* l=p;
+		int llen=eol-l;
+		*eol='\0';
+		p=eol+eollen;
+		int ns=0; //first nonspace position
+		bool commentLine=false;
+		while (l[ns]!=0 && isspace(l[ns])) ns++;
+		if (l[ns]=='#') {
+			commentLine=true;
+			if (llen<10) {
+				if (commentParser!=NULL) lblock.add(NULL, l);
+				continue;
+			}
+		}
+		GffLine* gl=new (lblock.arena.alloc(sizeof(GffLine))) GffLine(this, l, llen, &lblock.arena);
+		if (gl->skipLine || (gl->ID==NULL && gl->parents==NULL)) {
+			if (gl->skipLine && commentLine && commentParser!=NULL) lblock.add(NULL, l);
+			gl->~GffLine();
+			continue;
+		}
+		lblock.add(gl);
+	}
+}
+
+void GffReader::readAll(int nthreads) {
+#ifdef CUFFLINKS
+	nthreads=1; //the input checksum must be computed line by line
+#endif
+	if (nthreads<=1 || is_BED || fh==NULL) {
+		readAll();
+		return;
+	}
+	bool validation_errors = false;
+	GArenaScope ascope(use_Arena ? &objarena : GArena::active());
+	reserveIds();
+	{
+		GHash<CNonExon> pex;
+		//parse the first lines here until the input format is known; after that
+		//GffLine parsing does not depend on the records built so far
+		while (gff_type==0 && nextGffLine()!=NULL) {
+			processGffLine(pex, validation_errors);
+			deleteGffLine();
+		}
+		int nparts=GMIN(nthreads, GFF_MAX_PARTS);
+		GPVec<GffLineBlock> lblocks(nparts, true);
+		for (int t=0;t<nparts;t++) lblocks.Add(new GffLineBlock());
+		std::vector<std::thread> workers;
+		int blen=0;
+		char* block=NULL;
+		while ((block=linereader.getLines(blen, nparts*GFF_PARTSIZE))!=NULL) {
+			//split the block at line boundaries, the last part is parsed by this thread
+			char* bend=block+blen;
+			char* pstart=block;
+			int np=0;
+			while (np<nparts && pstart<bend) {
+				char* pend=bend;
+				if (np<nparts-1) {
+					char* ptarget=block+(int64)blen*(np+1)/nparts;
+					pend=nextLineStart(GMAX(ptarget, pstart), bend);
+				}
+				if (pend==bend)
+					parseGffBlock(pstart, pend-pstart, *lblocks[np]);
+				else
+					workers.push_back(std::thread(&GffReader::parseGffBlock, this, pstart, (int)(pend-pstart),
+							std::ref(*lblocks[np])));
+				pstart=pend;
+				np++;
+			}
+			for (size_t w=0;w<workers.size();w++) workers[w].join();
+			workers.clear();
+			//build the records in input order
+			for (int t=0;t<np;t++) {
+				GffLineBlock& lb=*lblocks[t];
+				for (uint i=0;i<lb.lines.Count();i++) {
+					if (lb.lines[i].gffline==NULL) {
+						(*commentParser)(lb.lines[i].comment, &gflst);
+						continue;
+					}
+					gffline=lb.lines[i].gffline;
+					noteGffLine(gffline);
+					processGffLine(pex, validation_errors);
+					deleteGffLine();
 				}
-			} //parented feature
-			//--
-			delete gffline;
-			gffline=NULL;
-		}//while gff lines
+				lb.clear();
+			}
+		}
 	}
+	readAllDone(validation_errors);
+}
+
+void GffReader::readAllDone(bool validation_errors) {
+	pexarena.clear(); //the subfeature pool is gone
 	if (gflst.Count()>0) {
 		gflst.finalize(this); //force sorting by locus if so constructed
 	}
+	if (num_Attrs) renumberNumRows();
 	// all gff records are now loaded in GList gflst
 	// so we can free the hash
 	phash.Clear();
+	pcache.clear();
 	//tids.Clear();
 	if (validation_errors) {
 		exit(1);
 	}
 }
 
+static char* gffAuxFileName(const char* fn, const char* ext) { //default index/snapshot file name
+	char* r=NULL;
+	GMALLOC(r, strlen(fn)+strlen(ext)+1);
+	strcpy(r, fn);
+	strcat(r, ext);
+	return r;
+}
+
+int64 GffReader::lineVOffset() {
+	int64 lpos=linereader.getLinePos();
+	return (gzreader!=NULL) ? gzreader->voffset(lpos) : lpos;
+}
+
+bool GffReader::seekInput(int64 voff) {
+	deleteGffLine();
+	if (gzreader!=NULL) {
+		if (!gzreader->seek(voff)) return false;
+		linereader.reset(voff & 0xFFFF); //positions are counted from the block start
+	}
+	else {
+		if (fh==NULL || fseeko(fh, voff, SEEK_SET)!=0) return false;
+		linereader.reset(voff);
+	}
+	return true;
+}
+
+int GffReader::buildIndex(const char* idxfn) {
+	if (fh==NULL) GError("Error: no input file to index!\n");
+	if (gzreader!=NULL && !gzreader->isBGZF())
+		GError("Error: cannot index gzip compressed %s, BGZF compression is required!\n", fname);
+	GffIndex* idx=new GffIndex();
+	bool validation_errors=false;
+	{
+		GArenaScope ascope(use_Arena ? &objarena : GArena::active());
+		if (is_BED) {
+			while (nextBEDLine()) {
+				GffIdxSeq* iseq=idx->addSeq(bedline->gseqname);
+				iseq->addLine(bedline->fstart, lineVOffset());
+				iseq->addSpan(bedline->fend-bedline->fstart+1);
+				processBEDLine();
+			}
+		}
+		else {
+			GHash<CNonExon> pex;
+			while (nextGffLine()!=NULL) {
+				idx->addSeq(gffline->gseqname)->addLine(gffline->fstart, lineVOffset());
+				processGffLine(pex, validation_errors);
+				deleteGffLine();
+			}
+			//record spans, before finalize() could discard any of them
+			for (int i=0;i<gflst.Count();i++) {
+				GffObj* gfo=gflst[i];
+				idx->addSeq(gfo->getGSeqName())->addSpan(gfo->end-gfo->start+1);
+			}
+		}
+		readAllDone(validation_errors);
+	}
+	if (idxfn==NULL && fname==NULL) GError("Error: buildIndex() needs an index file name!\n");
+	char* idxname=(idxfn!=NULL) ? Gstrdup(idxfn) : gffAuxFileName(fname, GFFIDX_EXT);
+	int r=idx->storeIndex(idxname);
+	GFREE(idxname);
+	delete regidx;
+	regidx=idx;
+	return r;
+}
+
+bool GffReader::loadIndex(const char* idxfn) {
+	if (idxfn==NULL && fname==NULL) return false;
+	char* idxname=(idxfn!=NULL) ? Gstrdup(idxfn) : gffAuxFileName(fname, GFFIDX_EXT);
+	GffIndex* idx=new GffIndex();
+	int r=(idxfn!=NULL || fileExists(idxname)==2) ? idx->loadIndex(idxname) : 0;
+	GFREE(idxname);
+	if (r==0) {
+		delete idx;
+		return false;
+	}
+	delete regidx;
+	regidx=idx;
+	return true;
+}
+
+int GffReader::readRegion(const char* chrom, uint start, uint end) {
+	if (readahead!=NULL) GError("Error: readRegion() cannot be used after startReadAhead()!\n");
+	if (regidx==NULL && !loadIndex())
+		GError("Error: no region index found for %s!\n", fname ? fname : "input");
+	clearRecords();
+	int64 vfrom=0, vto=0;
+	if (!regidx->getRange(chrom, start, end, vfrom, vto)) return 0;
+	if (!seekInput(vfrom)) GError("Error: cannot seek in %s!\n", fname ? fname : "input");
+	bool validation_errors=false;
+	GArenaScope ascope(use_Arena ? &objarena : GArena::active());
+	//records are built from all the lines on chrom in the index range;
+	//those only partially found there cannot overlap the region
+	if (is_BED) {
+		while (nextBEDLine()) {
+			if (lineVOffset()>vto) break;
+			if (strcmp(bedline->gseqname, chrom)==0) processBEDLine();
+			else { delete bedline; bedline=NULL; }
+		}
+		delete bedline;
+		bedline=NULL;
+	}
+	else {
+		GHash<CNonExon> pex;
+		while (nextGffLine()!=NULL) {
+			if (lineVOffset()>vto) break;
+			if (strcmp(gffline->gseqname, chrom)==0)
+				processGffLine(pex, validation_errors);
+			deleteGffLine();
+		}
+		deleteGffLine();
+	}
+	readAllDone(validation_errors);
+	GArenaScope noarena(NULL);
+	GList<GffObj> outside(false,true,false); //deleted when going out of scope
+	for (int i=0;i<gflst.Count();i++) {
+		GffObj* gfo=gflst[i];
+		if (gfo->overlap(start, end)) continue;
+		if (gfo->parent!=NULL) {
+			GPVec<GffObj>& pchildren=gfo->parent->children;
+			for (int c=0;c<pchildren.Count();c++) {
+				if (pchildren[c]==gfo) {
+					pchildren.Delete(c);
+					break;
+				}
+			}
+		}
+		for (int c=0;c<gfo->children.Count();c++)
+			gfo->children[c]->parent=NULL;
+		outside.Add(gfo);
+		gflst.Forget(i);
+	}
+	if (outside.Count()>0) {
+		gflst.Pack();
+		//seq stats and numeric rows only for the records returned
+		gseqStats.Clear();
+		gseqtable.Clear();
+		for (int i=0;i<gflst.Count();i++) updateSeqStats(gflst[i]);
+		if (num_Attrs) renumberNumRows();
+	}
+	return gflst.Count();
+}
+
+//--- GffReader snapshots
+#define GFFSNAP_MAGIC "GFS\004"
+
+//byte buffer for writing/reading a snapshot file in one go
+class GffSnapBuf {
+ public:
+	char* data;
+	size_t len;
+	size_t cap;
+	size_t pos; //read position
+	bool ok; //no read past the end of data
+	GffSnapBuf():data(NULL), len(0), cap(0), pos(0), ok(true) { }
+	~GffSnapBuf() { GFREE(data); }
+	void putBytes(const void* p, size_t n) {
+		if (len+n>cap) {
+			GArenaScope noarena(NULL);
+			cap=(cap==0) ? GBLOCK_READSIZE : cap;
+			while (len+n>cap) cap<<=1;
+			GREALLOC(data, cap);
+		}
+		memcpy(data+len, p, n);
+		len+=n;
+	}
+	template<class T> void put(T v) { putBytes(&v, sizeof(T)); }
+	void putStr(const char* str) {
+		int32_t l=(str==NULL) ? -1 : strlen(str);
+		put(l);
+		if (l>0) putBytes(str, l);
+	}
+	//front coding: the length of the prefix shared with prev, then the rest of str
+	void putPrefixed(const char* str, const char* prev) {
+		int p=0;
+		if (str!=NULL && prev!=NULL)
+			while (p<255 && str[p]!=0 && str[p]==prev[p]) p++;
+		put((uchar)p);
+		putStr(str==NULL ? NULL : str+p);
+	}
+	void getBytes(void* p, size_t n) {
+		if (!ok || pos+n>len) {
+			ok=false;
+			memset(p, 0, n);
+			return;
+		}
+		memcpy(p, data+pos, n);
+		pos+=n;
+	}
+	template<class T> T get() { T v; getBytes(&v, sizeof(T)); return v; }
+	char* getStr() { //allocated string, or NULL
+		int32_t l=get<int32_t>();
+		if (l<0 || !ok) return NULL;
+		if (pos+l>len) { ok=false; return NULL; }
+		char* r=NULL;
+		GMALLOC(r, l+1);
+		memcpy(r, data+pos, l);
+		r[l]=0;
+		pos+=l;
+		return r;
+	}
+	char* getPrefixed(const char* prev) { //string written by putPrefixed()
+		int p=get<uchar>();
+		int32_t l=get<int32_t>();
+		if (l<0 || !ok) return NULL;
+		if (pos+l>len || p>(prev==NULL ? 0 : (int)strlen(prev))) { ok=false; return NULL; }
+		char* r=NULL;
+		GMALLOC(r, p+l+1);
+		if (p>0) memcpy(r, prev, p);
+		memcpy(r+p, data+pos, l);
+		r[p+l]=0;
+		pos+=l;
+		return r;
+	}
+	bool writeFile(const char* fn) {
+		FILE* f=fopen(fn, "wb");
+		if (f==NULL) return false;
+		bool r=(fwrite(data, 1, len, f)==len);
+		return (fclose(f)==0 && r);
+	}
+	bool readFile(const char* fn) {
+		FILE* f=fopen(fn, "rb");
+		if (f==NULL) return false;
+		int64 fsize=0;
+		if (fseeko(f, 0, SEEK_END)==0) fsize=ftello(f);
+		rewind(f);
+		if (fsize>0) {
+			GArenaScope noarena(NULL);
+			cap=fsize;
+			GMALLOC(data, cap);
+			len=fread(data, 1, cap, f);
+		}
+		fclose(f);
+		pos=0;
+		ok=(fsize>0 && len==(size_t)fsize);
+		return ok;
+	}
+};
+
+//content fingerprint of a file: its size and the CRC32 of its data
+#define GFFSNAP_SAMPLESIZE 65536 //file head and tail bytes in a snapshot fingerprint
+#define GFFSNAP_SAMPLEBLOCKS 16 //blocks of GFFSNAP_SAMPLESIZE/16 sampled in between
+
+//size, modification time and a CRC of a sample of the input file (its whole content if
+//small), to tell if a snapshot was made from it, without reading all of it
+static bool gffFingerprint(const char* fn, int64& fsize, int64& fmtime, uint32_t& fcrc) {
+	struct stat st;
+	if (stat(fn, &st)!=0) return false;
+	FILE* f=fopen(fn, "rb");
+	if (f==NULL) return false;
+	fsize=st.st_size;
+	fmtime=st.st_mtime;
+	GArenaScope noarena(NULL);
+	char* buf=NULL;
+	GMALLOC(buf, GFFSNAP_SAMPLESIZE);
+	uLong crc=crc32(0L, Z_NULL, 0);
+	bool ok=true;
+	size_t r=0;
+	if (fsize<=4*GFFSNAP_SAMPLESIZE) {
+		while ((r=fread(buf, 1, GFFSNAP_SAMPLESIZE, f))>0)
+			crc=crc32(crc, (Bytef*)buf, r);
+	}
+	else {
+		const int64 bsize=GFFSNAP_SAMPLESIZE/16;
+		int64 mid=fsize-2*GFFSNAP_SAMPLESIZE; //sampled between the head and the tail
+		for (int b=-1;b<=GFFSNAP_SAMPLEBLOCKS && ok;b++) {
+			int64 pos=0, len=GFFSNAP_SAMPLESIZE;
+			if (b==GFFSNAP_SAMPLEBLOCKS) pos=fsize-GFFSNAP_SAMPLESIZE;
+			else if (b>=0) {
+				pos=GFFSNAP_SAMPLESIZE+(mid-bsize)*b/(GFFSNAP_SAMPLEBLOCKS-1);
+				len=bsize;
+			}
+			ok=(fseeko(f, pos, SEEK_SET)==0 && fread(buf, 1, len, f)==(size_t)len);
+			if (ok) crc=crc32(crc, (Bytef*)buf, len);
+		}
+	}
+	GFREE(buf);
+	fclose(f);
+	fcrc=crc;
+	return ok;
+}
+
+static int gffCmpNames(const pointer p1, const pointer p2) {
+	return strcmp((const char*)p1, (const char*)p2);
+}
+
+uint64_t GffReader::snapshotOptions() {
+	bool opts[]={is_BED, is_TLF, transcripts_Only, keep_Genes, keep_Attrs, keep_AllExonAttrs,
+		noExonAttrs, ignoreLocus, merge_CloseExons, gene2exon, sortByLoc, refAlphaSort,
+		attr_Filter, attr_Filter && attr_Exclude};
+	uint32_t r=0;
+	for (uint i=0;i<sizeof(opts)/sizeof(bool);i++)
+		if (opts[i]) r|=(1u<<i);
+	//the filtered attribute names (in any order) and the numeric attribute columns (in
+	//their order) go in the high 32 bits, as a CRC
+	uLong crc=crc32(0L, Z_NULL, 0);
+	if (attr_Filter) {
+		GPVec<char> fnames(attrFilter.Count(), false);
+		attrFilter.startIterate();
+		for (char* k=attrFilter.NextKey();k!=NULL;k=attrFilter.NextKey()) fnames.Add(k);
+		fnames.Sort(gffCmpNames);
+		for (int i=0;i<fnames.Count();i++)
+			crc=crc32(crc, (const Bytef*)fnames[i], strlen(fnames[i])+1);
+	}
+	crc=crc32(crc, (const Bytef*)"\t", 1);
+	for (int c=0;c<numCols.Count();c++)
+		crc=crc32(crc, (const Bytef*)numCols[c]->name, strlen(numCols[c]->name)+1);
+	return ((uint64_t)crc<<32) | r;
+}
+
+static void snapPutAttrs(GffSnapBuf& sb, GffAttrs* attrs) {
+	int32_t n=(attrs==NULL) ? -1 : attrs->Count();
+	sb.put(n);
+	for (int i=0;i<n;i++) {
+		GffAttr* a=attrs->Get(i);
+		sb.put((int32_t)a->id_full);
+		sb.putStr(a->attr_val);
+	}
+}
+
+static void snapPutExons(GffSnapBuf& sb, GList<GffExon>& segs, GffAttrs* gfoattrs) {
+	sb.put((int32_t)segs.Count());
+	for (int i=0;i<segs.Count();i++) {
+		GffExon* ex=segs[i];
+		sb.put(ex->start);
+		sb.put(ex->end);
+		sb.put(ex->exontype);
+		sb.put(ex->phase);
+		sb.put(ex->score.score);
+		sb.put(ex->score.precision);
+		bool gfoshared=(ex->attrs!=NULL && ex->attrs==gfoattrs);
+		sb.put((char)(gfoshared ? (ex->sharedAttrs ? 2 : 1) : 0));
+		if (!gfoshared) snapPutAttrs(sb, ex->attrs);
+	}
+}
+
+bool GffReader::saveSnapshot(const char* snapfn) {
+	if (fname==NULL) return false; //only for a named input file
+	int64 fsize=0, fmtime=0;
+	uint32_t fcrc=0;
+	if (!gffFingerprint(fname, fsize, fmtime, fcrc)) return false;
+	GffSnapBuf sb;
+	sb.putBytes(GFFSNAP_MAGIC, 4);
+	sb.put(fsize);
+	sb.put(fmtime);
+	sb.put(fcrc);
+	sb.put(snapshotOptions());
+	bool fmt[]={is_gff3, is_gtf, gtf_transcript, gtf_gene};
+	sb.putBytes(fmt, sizeof(fmt));
+	//the records refer to gene names and ids by their index in names->genes
+	GVec<int> geneids(2*gflst.Count()+1);
+	for (int i=0;i<gflst.Count();i++) {
+		GffObj* gfo=gflst[i];
+		geneids.cAdd(gfo->gene_name==NULL ? -1 : names->genes.addName(gfo->gene_name));
+		geneids.cAdd(gfo->geneID==NULL ? -1 : names->genes.addName(gfo->geneID));
+	}
+	GffNameList* dicts[]={&names->tracks, &names->gseqs,
+			&names->attrs, &names->feats, &names->genes};
+	for (int d=0;d<5;d++) {
+		sb.put((int32_t)dicts[d]->Count());
+		const char* prev=NULL;
+		for (int i=0;i<dicts[d]->Count();i++) {
+			const char* name=dicts[d]->Get(i)->name;
+			sb.putPrefixed(name, prev);
+			prev=name;
+		}
+	}
+	//record indexes are kept in udata for the parent/children links
+	GVec<int> udata(gflst.Count());
+	for (int i=0;i<gflst.Count();i++) {
+		udata.Add(gflst[i]->udata);
+		gflst[i]->udata=i;
+	}
+	sb.put((int32_t)gflst.Count());
+	const char* previd=NULL;
+	for (int i=0;i<gflst.Count();i++) {
+		GffObj* gfo=gflst[i];
+		sb.put(gfo->start);
+		sb.put(gfo->end);
+		sb.putPrefixed(gfo->gffID, previd);
+		if (gfo->gffID!=NULL) previd=gfo->gffID;
+		sb.put((int32_t)geneids[2*i]);
+		sb.put((int32_t)geneids[2*i+1]);
+		sb.put(gfo->flags);
+		sb.put((int32_t)gfo->track_id);
+		sb.put((int32_t)gfo->gseq_id);
+		sb.put((int32_t)gfo->ftype_id);
+		sb.put((int32_t)gfo->subftype_id);
+		sb.put(gfo->CDstart);
+		sb.put(gfo->CDend);
+		sb.put(gfo->CDphase);
+		sb.put(gfo->strand);
+		sb.put(gfo->gscore.score);
+		sb.put(gfo->gscore.precision);
+		sb.put((int32_t)gfo->covlen);
+		bool inlst=(gfo->parent!=NULL && gfo->parent->udata>=0 && gfo->parent->udata<gflst.Count() &&
+				gflst[gfo->parent->udata]==gfo->parent);
+		sb.put((int32_t)(inlst ? gfo->parent->udata : -1));
+		GVec<int> kids(gfo->children.Count());
+		for (int c=0;c<gfo->children.Count();c++) {
+			GffObj* k=gfo->children[c];
+			if (k->udata>=0 && k->udata<gflst.Count() && gflst[k->udata]==k) kids.Add(k->udata);
+		}
+		sb.put((int32_t)kids.Count());
+		for (int c=0;c<kids.Count();c++) sb.put((int32_t)kids[c]);
+		snapPutAttrs(sb, gfo->getAttrs());
+		snapPutExons(sb, gfo->exons, gfo->attrs);
+		sb.put((char)(gfo->cdss!=NULL));
+		if (gfo->cdss!=NULL) snapPutExons(sb, *(gfo->cdss), gfo->attrs);
+	}
+	//numeric attribute columns: they can also take the values of attributes not kept
+	//as strings (filtered out, or from exon lines)
+	for (int c=0;c<numCols.Count();c++) {
+		for (int i=0;i<gflst.Count();i++) {
+			int r=gflst[i]->numrow;
+			sb.put(r<0 ? (double)NAN : numCols[c]->values[r]);
+		}
+	}
+	for (int i=0;i<gflst.Count();i++) gflst[i]->udata=udata[i];
+	char* sfname=(snapfn!=NULL) ? Gstrdup(snapfn) : gffAuxFileName(fname, GFFSNAP_EXT);
+	bool r=sb.writeFile(sfname);
+	if (!r) GMessage("Warning: could not write snapshot file %s!\n", sfname);
+	GFREE(sfname);
+	return r;
+}
+
+static GffAttrs* snapGetAttrs(GffSnapBuf& sb, GVec<int>& attrmap) {
+	int32_t n=sb.get<int32_t>();
+	if (n<0 || !sb.ok) return NULL;
+	GffAttrs* attrs=new GffAttrs();
+	for (int i=0;i<n && sb.ok;i++) {
+		GffAttr* a=new GffAttr(0);
+		a->id_full=sb.get<int32_t>();
+		if (a->attr_id<0 || a->attr_id>=attrmap.Count()) { sb.ok=false; delete a; break; }
+		a->attr_id=attrmap[a->attr_id];
+		a->attr_val=sb.getStr();
+		attrs->Add(a);
+	}
+	return attrs;
+}
+
+static void snapGetExons(GffSnapBuf& sb, GList<GffExon>& segs, GffAttrs* gfoattrs, GVec<int>& attrmap) {
+	int32_t n=sb.get<int32_t>();
+	for (int i=0;i<n && sb.ok;i++) {
+		GffExon* ex=new GffExon(false);
+		ex->start=sb.get<uint>();
+		ex->end=sb.get<uint>();
+		ex->exontype=sb.get<int8_t>();
+		ex->phase=sb.get<char>();
+		ex->score.score=sb.get<float>();
+		ex->score.precision=sb.get<int8_t>();
+		char shared=sb.get<char>();
+		if (shared) {
+			ex->attrs=gfoattrs;
+			ex->sharedAttrs=(shared==2);
+			if (!ex->sharedAttrs && gfoattrs!=NULL) gfoattrs->ref();
+		}
+		else ex->attrs=snapGetAttrs(sb, attrmap);
+		segs.Add(ex);
+	}
+}
+
+bool GffReader::loadSnapshot(const char* snapfn) {
+	if (fname==NULL) return false;
+	char* sfname=(snapfn!=NULL) ? Gstrdup(snapfn) : gffAuxFileName(fname, GFFSNAP_EXT);
+	GffSnapBuf sb;
+	bool r=sb.readFile(sfname);
+	GFREE(sfname);
+	if (!r) return false;
+	char magic[4];
+	sb.getBytes(magic, 4);
+	if (!sb.ok || memcmp(magic, GFFSNAP_MAGIC, 4)!=0) return false;
+	int64 ssize=sb.get<int64>();
+	int64 smtime=sb.get<int64>();
+	uint32_t scrc=sb.get<uint32_t>();
+	if (sb.get<uint64_t>()!=snapshotOptions()) return false;
+	int64 fsize=0, fmtime=0;
+	uint32_t fcrc=0;
+	if (!gffFingerprint(fname, fsize, fmtime, fcrc) || fsize!=ssize || fmtime!=smtime || fcrc!=scrc)
+		return false; //stale snapshot
+	bool fmt[4];
+	sb.getBytes(fmt, sizeof(fmt));
+	//snapshot name ids => ids in this reader's names
+	GffNameList* dicts[]={&names->tracks, &names->gseqs,
+			&names->attrs, &names->feats, &names->genes};
+	GVec<int> idmaps[5];
+	for (int d=0;d<5 && sb.ok;d++) {
+		int32_t n=sb.get<int32_t>();
+		char* prev=NULL;
+		for (int i=0;i<n && sb.ok;i++) {
+			char* name=sb.getPrefixed(prev);
+			GFREE(prev);
+			if (name==NULL) { sb.ok=false; break; }
+			idmaps[d].cAdd(dicts[d]->addName(name));
+			prev=name;
+		}
+		GFREE(prev);
+	}
+	if (!sb.ok) return false;
+	GVec<int>& trackmap=idmaps[0];
+	GVec<int>& gseqmap=idmaps[1];
+	GVec<int>& attrmap=idmaps[2];
+	GVec<int>& featmap=idmaps[3];
+	GVec<int>& genemap=idmaps[4];
+	clearRecords();
+	int32_t n=sb.get<int32_t>();
+	GPVec<GffObj> gfos(n>0 ? n : 1, false);
+	GVec<int> parents(n>0 ? n : 1);
+	GVec<int> kids(n>0 ? n : 1); //children indexes of all the records
+	GVec<int> kidstart(n>0 ? n+1 : 1); //where the children of each record start in kids
+	int nv=(n>0) ? n*numCols.Count() : 0;
+	GVec<double> numvals(nv>0 ? nv : 1); //numeric column values, column by column
+	GArenaScope ascope(use_Arena ? &objarena : GArena::active());
+	const char* previd=NULL;
+	for (int i=0;i<n && sb.ok;i++) {
+		GffObj* gfo=new GffObj(NULL, names);
+		gfo->flag_GENE_DICT=true;
+		gfos.Add(gfo);
+		gfo->start=sb.get<uint>();
+		gfo->end=sb.get<uint>();
+		gfo->gffID=sb.getPrefixed(previd);
+		if (gfo->gffID!=NULL) previd=gfo->gffID;
+		int32_t gids[2];
+		sb.getBytes(gids, sizeof(gids));
+		for (int k=0;k<2;k++) {
+			if (gids[k]>=genemap.Count()) { sb.ok=false; gids[k]=-1; }
+		}
+		if (gids[0]>=0) gfo->gene_name=names->genes.getName(genemap[gids[0]]);
+		if (gids[1]>=0) gfo->geneID=names->genes.getName(genemap[gids[1]]);
+		gfo->flags=sb.get<uint>();
+		gfo->flag_GENE_DICT=true; //the gene strings above
+		int32_t ids[4];
+		sb.getBytes(ids, sizeof(ids));
+		GVec<int>* maps[]={&trackmap, &gseqmap, &featmap, &featmap};
+		for (int k=0;k<4;k++) {
+			if (ids[k]>=maps[k]->Count()) sb.ok=false;
+			else if (ids[k]>=0) ids[k]=maps[k]->Get(ids[k]);
+		}
+		gfo->track_id=ids[0];
+		gfo->gseq_id=ids[1];
+		gfo->ftype_id=ids[2];
+		gfo->subftype_id=ids[3];
+		gfo->CDstart=sb.get<uint>();
+		gfo->CDend=sb.get<uint>();
+		gfo->CDphase=sb.get<char>();
+		gfo->strand=sb.get<char>();
+		gfo->gscore.score=sb.get<float>();
+		gfo->gscore.precision=sb.get<int8_t>();
+		gfo->covlen=sb.get<int32_t>();
+		parents.cAdd(sb.get<int32_t>());
+		kidstart.cAdd(kids.Count());
+		int32_t nk=sb.get<int32_t>();
+		for (int c=0;c<nk && sb.ok;c++) kids.cAdd(sb.get<int32_t>());
+		gfo->attrs=snapGetAttrs(sb, attrmap);
+		snapGetExons(sb, gfo->exons, gfo->attrs, attrmap);
+		if (sb.get<char>()) {
+			gfo->cdss=new GList<GffExon>(true, true, false);
+			snapGetExons(sb, *(gfo->cdss), gfo->attrs, attrmap);
+		}
+		gfo->shareExonAttrs(attrPool);
+		gfo->packExons();
+		if (gfo->gseq_id<0) sb.ok=false;
+	}
+	kidstart.cAdd(kids.Count());
+	for (int i=0;i<gfos.Count() && sb.ok;i++) { //restore the links
+		GffObj* gfo=gfos[i];
+		if (parents[i]>=gfos.Count()) { sb.ok=false; break; }
+		if (parents[i]>=0) gfo->parent=gfos[parents[i]];
+		for (int c=kidstart[i];c<kidstart[i+1];c++) {
+			if (kids[c]<0 || kids[c]>=gfos.Count()) { sb.ok=false; break; }
+			gfo->children.Add(gfos[kids[c]]);
+		}
+	}
+	for (int v=0;v<nv && sb.ok;v++) numvals.cAdd(sb.get<double>());
+	if (!sb.ok || gfos.Count()!=n) {
+		GMessage("Warning: invalid snapshot data, ignored.\n");
+		for (int i=0;i<gfos.Count();i++) delete gfos[i];
+		return false;
+	}
+	is_gff3=fmt[0]; is_gtf=fmt[1]; gtf_transcript=fmt[2]; gtf_gene=fmt[3];
+	GArenaScope noarena(NULL);
+	for (int i=0;i<gfos.Count();i++) {
+		gflst.Add(gfos[i]);
+		updateSeqStats(gfos[i]);
+		for (int c=0;c<numCols.Count();c++) {
+			double v=numvals[c*n+i];
+			if (std::isnan(v)) continue;
+			if (gfos[i]->numrow<0) addNumRow(gfos[i]);
+			numCols[c]->values[gfos[i]->numrow]=v;
+		}
+	}
+	if (sortByLoc) {
+		gflst.setSorted(false);
+		if (refAlphaSort)
+			gflst.setSorted((GCompareProc*)gfo_cmpByLoc);
+		else
+			gflst.setSorted((GCompareProc*)gfo_cmpRefByID);
+	}
+	if (num_Attrs) renumberNumRows();
+	return true;
+}
+
+bool GffReader::readAllCached(const char* snapfn) {
+	if (loadSnapshot(snapfn)) return true;
+	readAll();
+	saveSnapshot(snapfn);
+	return false;
+}
+
 void GfList::finalize(GffReader* gfr) { //if set, enforce sort by locus
   GList<GffObj> discarded(false,true,false);
   for (int i=0;i<Count();i++) {
     //finalize the parsing of each GffObj
     fList[i]->finalize(gfr);
     if (fList[i]->isDiscarded()) {
-       discarded.Add(fList[i]);
+       {
+         GArenaScope noarena(NULL);
+         discarded.Add(fList[i]);
+       }
        //inform parent that thiis child is removed
        if (fList[i]->parent!=NULL) {
     	   GPVec<GffObj>& pchildren=fList[i]->parent->children;
@@ -1874,6 +3326,7 @@ void GfList::finalize(GffReader* gfr) { //if set, enforce sort by locus
 
 bool GffObj::reduceExonAttrs(GList<GffExon>& segs) {
 	bool attrs_discarded=false;
+	GffAttrs::own(segs[0]->attrs);
 	for (int a=0;a<segs[0]->attrs->Count();a++) {
 		int attr_id=segs[0]->attrs->Get(a)->attr_id;
 		char* attr_name=names->attrs.getName(attr_id);
@@ -1896,7 +3349,7 @@ bool GffObj::reduceExonAttrs(GList<GffExon>& segs) {
 				//rename it if it exists and is different for the transcript!
 				char* t_val=NULL;
 				bool same_aval=false;
-				if (this->attrs!=NULL &&
+				if (this->getAttrs()!=NULL &&
 						(t_val=this->attrs->getAttr(attr_id))!=NULL) {
 					//same attribute name already exists for the transcript!
 					//write it using CDS_ or exon_ prefix
@@ -1909,7 +3362,7 @@ bool GffObj::reduceExonAttrs(GList<GffExon>& segs) {
 						new_attr_name[0]=0;
 						strcat(new_attr_name, prefix);
 						strcat(new_attr_name, attr_name);
-						this->attrs->add_or_update(names, new_attr_name, attr_val);
+						GffAttrs::own(this->attrs)->add_or_update(names, new_attr_name, attr_val);
 						GFREE(new_attr_name);
 					}
 				}
@@ -2024,8 +3477,7 @@ bool GffObj::processGeneSegments(GffReader* gfr) {
         }
         GffObj* t=children[gc.mxs.First().child_idx];
 		for (int c=0;c<gc.cdsList.Count();c++) {
-			t->transferCDS(cdss->Get(gc.cdsList[c].idx));
-			cdss->Forget(gc.cdsList[c].idx);
+			t->transferCDS(detachExon(gc.cdsList[c].idx, cdss));
 			cds_moved++;
 		}
 		// also remove it from the list of gene_segments to be mapped
@@ -2084,6 +3536,7 @@ GffObj* GffObj::finalize(GffReader* gfr) {
 	isFinalized(true);
 
 	if (isDiscarded()) {
+		flag_SEG_BOUNDS=false;
 		//just in case we have cds with uptr in use (X_gene_segment), free them
 		uptr=NULL;
 		udata=0;
@@ -2117,6 +3570,7 @@ GffObj* GffObj::finalize(GffReader* gfr) {
 		CDphase=0;
 		CDend=0;
 	}
+	flag_SEG_BOUNDS=false; //exons may be edited freely from here on
 	//-- attribute reduction for some records which
 	//   repeat the exact same attr=value for every exon
 	bool reduceAttributes=(gfr->keep_Attrs && !gfr->noExonAttrs &&
@@ -2154,7 +3608,7 @@ GffObj* GffObj::finalize(GffReader* gfr) {
 					if (exons[ni]->attrs!=NULL && (exons[i]->attrs==NULL ||
 							exons[i]->attrs->Count()<exons[ni]->attrs->Count())) {
 						//use the other exon attributes, if it has more
-						delete(exons[i]->attrs);
+						GffAttrs::unref(exons[i]->attrs);
 						exons[i]->attrs=exons[ni]->attrs;
 						exons[ni]->attrs=NULL;
 					}
@@ -2263,11 +3717,9 @@ GffObj* GffObj::finalize(GffReader* gfr) {
 					if ((*cdss)[i]->attrs!=NULL && (*cdss)[i]->attrs->Count()>0) {
 						if (exons[eidx]->attrs==NULL)
 							exons[eidx]->attrs=new GffAttrs();
-						exons[eidx]->attrs->copyAttrs((*cdss)[i]->attrs, true);
-						if (exons[eidx]->attrs->Count()==0) {
-							delete exons[eidx]->attrs;
-							exons[eidx]->attrs=NULL;
-						}
+						GffAttrs::own(exons[eidx]->attrs)->copyAttrs((*cdss)[i]->attrs, true);
+						if (exons[eidx]->attrs->Count()==0)
+							GffAttrs::unref(exons[eidx]->attrs);
 					}
 					++eidx;
 				}
@@ -2278,27 +3730,93 @@ GffObj* GffObj::finalize(GffReader* gfr) {
 		} else this->isXCDS(true);
 	}//cdss check
 
+	if (gfr->keep_Attrs && !gfr->noExonAttrs)
+		shareExonAttrs(gfr->attrPool);
+	packExons();
 	//--- collect stats for the reference genomic sequence
-	if (gfr->gseqtable.Count()<=gseq_id) {
-		gfr->gseqtable.setCount(gseq_id+1);
+	gfr->updateSeqStats(this);
+	uptr=NULL;
+	udata=0;
+	return this;
+}
+
+static void packSegs(GList<GffExon>& segs, GffExon*& p) {
+	for (int i=0;i<segs.Count();i++) {
+		GffExon* ex=segs.Get(i);
+		GffExon* px=::new(p++) GffExon(false);
+		*px=*ex; //takes over attrs and uptr
+		px->packed=true;
+		ex->attrs=NULL;
+		ex->uptr=NULL;
+		GPVec<GffExon>::DefaultFreeProc(ex);
+		segs.Put(i, px);
+	}
+}
+
+void GffObj::packExons() {
+	//one allocation for all the segments, laid out in order, so that coordinate
+	//scans walk consecutive memory; exons added later are allocated separately
+	int n=exons.Count();
+	if (cdss!=NULL) n+=cdss->Count();
+	if (n<2) return;
+	GffExon* oldblock=exblock; //repacking: its remaining slots were destroyed by packSegs()
+	GMALLOC(exblock, n*sizeof(GffExon));
+	GffExon* p=exblock;
+	packSegs(exons, p);
+	if (cdss!=NULL) packSegs(*cdss, p);
+	GFREE(oldblock);
+}
+
+void GffObj::shareExonAttrs(GffAttrsPool& pool) {
+	//segments often repeat the same attributes (e.g. with keepAttrs(true,false,true)), and
+	//so do the records; only lists owned by a segment are pooled (not the borrowed ones)
+	for (int i=0;i<exons.Count();i++) {
+		GffExon* ex=exons[i];
+		if (ex->attrs!=NULL && !ex->sharedAttrs && ex->attrs!=attrs)
+			ex->attrs=pool.intern(ex->attrs);
 	}
-	GSeqStat* gsd=gfr->gseqtable[gseq_id];
+	if (cdss==NULL) return;
+	for (int i=0;i<cdss->Count();i++) {
+		GffExon* ex=(*cdss)[i];
+		if (ex->attrs!=NULL && !ex->sharedAttrs && ex->attrs!=attrs)
+			ex->attrs=pool.intern(ex->attrs);
+	}
+}
+
+void GffReader::clearRecords() {
+	if (use_Arena) gflst.freeAll();
+	else gflst.freeUnused();
+	gflst.Clear();
+	discarded_ids.Clear();
+	phash.Clear();
+	pcache.clear();
+	gseqStats.Clear();
+	gseqtable.Clear();
+	attrPool.Clear(); //the records still in use keep their own references to pooled lists
+	clearNumRows();
+	if (use_Arena) objarena.reset();
+}
+
+void GffReader::updateSeqStats(GffObj* gfo) {
+	GArenaScope noarena(NULL);
+	int gseq_id=gfo->gseq_id;
+	if (gseqtable.Count()<=gseq_id) {
+		gseqtable.setCount(gseq_id+1);
+	}
+	GSeqStat* gsd=gseqtable[gseq_id];
 	if (gsd==NULL) {
 		gsd=new GSeqStat(gseq_id,names->gseqs.getName(gseq_id));
-		//gfr->gseqtable.Put(gseq_id, gsd);
-		gfr->gseqtable[gseq_id]=gsd;
-		gfr->gseqStats.Add(gsd);
+		//gseqtable.Put(gseq_id, gsd);
+		gseqtable[gseq_id]=gsd;
+		gseqStats.Add(gsd);
 	}
 	gsd->fcount++;
-	if (start<gsd->mincoord) gsd->mincoord=start;
-	if (end>gsd->maxcoord) gsd->maxcoord=end;
-	if (this->len()>gsd->maxfeat_len) {
-		gsd->maxfeat_len=this->len();
-		gsd->maxfeat=this;
+	if (gfo->start<gsd->mincoord) gsd->mincoord=gfo->start;
+	if (gfo->end>gsd->maxcoord) gsd->maxcoord=gfo->end;
+	if (gfo->len()>gsd->maxfeat_len) {
+		gsd->maxfeat_len=gfo->len();
+		gsd->maxfeat=gfo;
 	}
-	uptr=NULL;
-	udata=0;
-	return this;
 }
 
 void GffObj::printExonList(FILE* fout) {
@@ -2330,6 +3848,12 @@ void BED_addAttribute(FILE* fout, int& acc, const char* format,... ) {
     va_end(arguments);
 }
 
+//GFF3 attribute output format: a value containing ';' (from a quoted GTF value)
+//is written double-quoted, so it is read back as a single value
+static inline const char* gff3AttrFmt(const char* v) {
+	return (strchr(v, ';')!=NULL) ? ";%s=\"%s\"" : ";%s=%s";
+}
+
 void GffObj::printBED(FILE* fout, bool cvtChars, char* dbuf, int dbuf_len) {
 //print a BED-12 line + GFF3 attributes in 13th field
  int cd_start=CDstart>0? CDstart-1 : start-1;
@@ -2356,7 +3880,7 @@ void GffObj::printBED(FILE* fout, bool cvtChars, char* dbuf, int dbuf_len) {
 	 BED_addAttribute(fout, numattrs, "geneID=%s",geneID);
  if (gene_name!=NULL)
     fprintf(fout, ";gene_name=%s",gene_name);
- if (attrs!=NULL) {
+ if (getAttrs()!=NULL) {
     for (int i=0;i<attrs->Count();i++) {
       const char* attrname=names->attrs.getName(attrs->Get(i)->attr_id);
       const char* attrval=attrs->Get(i)->attr_val;
@@ -2366,21 +3890,191 @@ void GffObj::printBED(FILE* fout, bool cvtChars, char* dbuf, int dbuf_len) {
       }
       if (cvtChars) {
     	  decodeHexChars(dbuf, attrval, dbuf_len-1);
-    	  BED_addAttribute(fout, numattrs, "%s=%s", attrname, dbuf);
+    	  BED_addAttribute(fout, numattrs, gff3AttrFmt(dbuf)+1, attrname, dbuf);
       }
       else
-    	  BED_addAttribute(fout, numattrs,"%s=%s", attrname, attrs->Get(i)->attr_val);
+    	  BED_addAttribute(fout, numattrs, gff3AttrFmt(attrval)+1, attrname, attrval);
     }
  }
  fprintf(fout, "\n");
 }
 
+void GffAttrs::Grow() {
+	reserve(fCapacity*2, 0);
+}
+
+char* GffAttrs::storeValue(const char* vstart, const char* vend) {
+	int len=(vend<vstart) ? 0 : (int)(vend-vstart)+1;
+	if (vals==NULL || vals->cap-vals->used<len+1) {
+		int cap=(vals==NULL) ? 0 : GMAX(vals->cap*2, GFFATTRS_VALCHUNK);
+		if (cap<len+1) cap=len+1;
+		ValChunk* c=NULL;
+		GMALLOC(c, sizeof(ValChunk)+cap);
+		c->next=vals;
+		c->cap=cap;
+		c->used=0;
+		vals=c;
+	}
+	char* v=vals->data()+vals->used;
+	memcpy(v, vstart, len);
+	v[len]=0;
+	vals->used+=len+1;
+	return v;
+}
+
+char* GffAttrs::replaceValue(GffAttr& a, const char* vstart, const char* vend) {
+	if (!a.pooled || a.attr_val==NULL) {
+		freeVal(a);
+		return storeValue(vstart, vend);
+	}
+	int len=(int)(vend-vstart)+1;
+	int olen=strlen(a.attr_val);
+	if (len<=olen) { //fits in the old value's place
+		memmove(a.attr_val, vstart, len);
+		a.attr_val[len]=0;
+		return a.attr_val;
+	}
+	//the last value stored goes back to its chunk
+	if (a.attr_val+olen+1==vals->data()+vals->used) vals->used-=olen+1;
+	return storeValue(vstart, vend);
+}
+
+void GffAttrs::reserve(int n, int vlen) {
+	if (n>fCapacity) {
+		GffAttr* newlist=NULL;
+		GMALLOC(newlist, n*sizeof(GffAttr));
+		memcpy((void*)newlist, (void*)fList, fCount*sizeof(GffAttr));
+		if (fList!=(GffAttr*)fInline) GFREE(fList);
+		fList=newlist;
+		fCapacity=n;
+	}
+	if (vals!=NULL || vlen<=0) return;
+	GMALLOC(vals, sizeof(ValChunk)+vlen);
+	vals->next=NULL;
+	vals->cap=vlen;
+	vals->used=0;
+}
+
+void GffAttrs::Pack() {
+	int j=0;
+	for (int i=0;i<fCount;i++) {
+		if (fList[i].attr_id<0) continue;
+		if (i!=j) fList[j]=fList[i];
+		j++;
+	}
+	fCount=j;
+}
+
+void GffAttrs::Clear() {
+	for (int i=0;i<fCount;i++)
+		if (!fList[i].pooled) GFREE(fList[i].attr_val);
+	fCount=0;
+	if (fList!=(GffAttr*)fInline) {
+		GFREE(fList);
+		fList=(GffAttr*)fInline;
+		fCapacity=GFFATTRS_INLINE;
+	}
+	while (vals!=NULL) {
+		ValChunk* c=vals;
+		vals=c->next;
+		GFREE(c);
+	}
+}
+
+GffAttrs* GffAttrs::clone() {
+	GffAttrs* c=new GffAttrs();
+	int vlen=0;
+	for (int i=0;i<fCount;i++)
+		if (fList[i].attr_val!=NULL) vlen+=strlen(fList[i].attr_val)+1;
+	c->reserve(fCount, vlen);
+	for (int i=0;i<fCount;i++) {
+		GffAttr& a=c->newEntry(0);
+		a.id_full=fList[i].id_full;
+		const char* v=fList[i].attr_val;
+		if (v!=NULL) {
+			a.attr_val=c->storeValue(v, v+strlen(v)-1);
+			a.pooled=true;
+		}
+	}
+	return c;
+}
+
+bool GffAttrs::sameAs(GffAttrs& o) {
+	if (fCount!=o.fCount) return false;
+	for (int i=0;i<fCount;i++) {
+		GffAttr& a=fList[i];
+		GffAttr& b=o.fList[i];
+		if (a.id_full!=b.id_full) return false;
+		if (a.attr_val==NULL || b.attr_val==NULL) {
+			if (a.attr_val!=b.attr_val) return false;
+		}
+		else if (strcmp(a.attr_val, b.attr_val)!=0) return false;
+	}
+	return true;
+}
+
+uint64_t GffAttrs::contentHash() {
+	uint64_t h=(uint64_t)fCount;
+	for (int i=0;i<fCount;i++) {
+		const char* v=fList[i].attr_val;
+		h=(h^(uint)fList[i].id_full)*0x9E3779B97F4A7C15ULL;
+		if (v!=NULL) h^=gstrhash64(v, strlen(v));
+	}
+	return h;
+}
+
+void GffAttrsPool::Grow() {
+	int ncap=(cap==0) ? 1024 : cap*2;
+	GffAttrs** nslots=NULL;
+	GCALLOC(nslots, ncap*sizeof(GffAttrs*));
+	for (int i=0;i<cap;i++) {
+		if (slots[i]==NULL) continue;
+		int k=(int)(slots[i]->chash & (ncap-1));
+		while (nslots[k]!=NULL) k=(k+1) & (ncap-1);
+		nslots[k]=slots[i];
+	}
+	GFREE(slots);
+	slots=nslots;
+	cap=ncap;
+}
+
+GffAttrs* GffAttrsPool::intern(GffAttrs* a) {
+	if (a==NULL) return NULL;
+	GArenaScope noarena(NULL); //the table is released by Clear(), not with any arena
+	if (2*(count+1)>cap) Grow();
+	uint64_t h=a->contentHash();
+	int k=(int)(h & (cap-1));
+	while (slots[k]!=NULL) {
+		GffAttrs* p=slots[k];
+		if (p==a) return a;
+		if (p->chash==h && p->sameAs(*a)) {
+			p->ref();
+			GffAttrs::unref(a);
+			return p;
+		}
+		k=(k+1) & (cap-1);
+	}
+	a->chash=h;
+	slots[k]=a->ref(); //the pool's own reference
+	count++;
+	return a;
+}
+
+void GffAttrsPool::Clear() {
+	for (int i=0;i<cap;i++)
+		GffAttrs::unref(slots[i]);
+	GFREE(slots);
+	cap=0;
+	count=0;
+}
+
 void GffObj::parseAttrs(GffAttrs*& atrlist, char* info, bool isExon, bool CDSsrc) {
   if (names==NULL)
      GError(ERR_NULL_GFNAMES, "parseAttrs()");
   if (atrlist==NULL) {
       atrlist=new GffAttrs();
   }
+  else GffAttrs::own(atrlist);
   bool exon2transcript=(isExon && atrlist==this->attrs);
   char* endinfo=info+strlen(info);
   char* start=info;
@@ -2415,21 +4109,146 @@ void GffObj::parseAttrs(GffAttrs*& atrlist, char* info, bool isExon, bool CDSsrc
     }
     start=pch;
   } //while info characters
-  if (atrlist->Count()==0) { delete atrlist; atrlist=NULL; }
+  if (atrlist->Count()==0) GffAttrs::unref(atrlist);
+}
+
+void GffObj::parseAttrs(GffAttrs*& atrlist, GffLine& gl, bool isExon, bool CDSsrc) {
+  if (names==NULL)
+     GError(ERR_NULL_GFNAMES, "parseAttrs()");
+  if (flag_LAZY_ATTRS && &atrlist==&attrs && attrs==NULL) {
+      //record attributes not read yet, keep them raw
+      stashAttrs(gl, isExon, CDSsrc);
+      return;
+  }
+  if (atrlist==NULL) {
+      atrlist=new GffAttrs();
+      int n=0, vlen=0; //the raw values can only be trimmed
+      for (int i=0;i<gl.numAttrToks;i++)
+        if (!gl.attrToks[i].deleted) { n++; vlen+=gl.attrToks[i].vlen+1; }
+      atrlist->reserve(n, vlen);
+  }
+  else GffAttrs::own(atrlist);
+  bool exon2transcript=(isExon && atrlist==this->attrs);
+  for (int i=0;i<gl.numAttrToks;i++) {
+    GffAttrTok& t=gl.attrToks[i];
+    if (t.deleted) continue;
+    const char* name=gl.line+t.key;
+    const char* value=gl.line+t.val;
+    if (exon2transcript) { //we do NOT want these exon attributes at transcript level
+       if (startsiWith(name, "exon_") || strcmp(name, "exon")==0) continue;
+       atrlist->add_if_new(this->names, name, value); //never override transcript attribute with exon's
+    }
+    else atrlist->add_or_update(this->names, name, value, CDSsrc); //overwrite previous attr with the same name
+  }
+  if (atrlist->Count()==0) GffAttrs::unref(atrlist);
+}
+
+//if an attribute name is already in a raw attribute blob (see GffObj::stashAttrs())
+static bool rawAttrSeen(const char* raw, int rlen, const char* name) {
+	for (int p=0;p<rlen;) {
+		int n=(uchar)raw[p+1] | ((uchar)raw[p+2]<<8);
+		p+=3;
+		for (int k=0;k<n;k++) {
+			if (strcmp(raw+p, name)==0) return true;
+			p+=strlen(raw+p)+1;
+			p+=strlen(raw+p)+1;
+		}
+	}
+	return false;
+}
+
+//same filtering as parseAttrs(); for exon2transcript only the first value of a name
+//is ever used, so the names already stashed are not stored again
+static bool stashAttrTok(GffLine& gl, GffAttrTok& t, bool exon2transcript, const char* raw, int rlen) {
+	if (t.deleted) return false;
+	const char* name=gl.line+t.key;
+	if (exon2transcript) {
+		if (startsiWith(name, "exon_") || strcmp(name, "exon")==0) return false;
+		if (rawAttrSeen(raw, rlen, name)) return false;
+	}
+	return true;
+}
+
+void GffObj::stashAttrs(GffLine& gl, bool exon2transcript, bool CDSsrc) {
+	int seglen=3, npairs=0;
+	for (int i=0;i<gl.numAttrToks;i++) {
+		GffAttrTok& t=gl.attrToks[i];
+		if (!stashAttrTok(gl, t, exon2transcript, rawattrs, rawattrs_len)) continue;
+		seglen+=strlen(gl.line+t.key)+strlen(gl.line+t.val)+2;
+		npairs++;
+	}
+	if (npairs==0) return;
+	int rlen=rawattrs_len;
+	GREALLOC(rawattrs, rlen+seglen);
+	char* p=rawattrs+rlen;
+	*p++=(exon2transcript ? 1 : 0) | (CDSsrc ? 2 : 0);
+	*p++=(char)(npairs & 0xFF);
+	*p++=(char)(npairs >> 8);
+	for (int i=0;i<gl.numAttrToks;i++) {
+		GffAttrTok& t=gl.attrToks[i];
+		if (!stashAttrTok(gl, t, exon2transcript, rawattrs, rlen)) continue;
+		const char* name=gl.line+t.key;
+		const char* value=gl.line+t.val;
+		int l=strlen(name)+1;
+		memcpy(p, name, l); p+=l;
+		l=strlen(value)+1;
+		memcpy(p, value, l); p+=l;
+	}
+	rawattrs_len=rlen+seglen;
+}
+
+void GffObj::loadAttrs() {
+	char* raw=rawattrs;
+	int rlen=rawattrs_len;
+	rawattrs=NULL; //attrs is final from here on
+	rawattrs_len=0;
+	if (attrs==NULL) {
+		attrs=new GffAttrs();
+		int na=0, vlen=0;
+		for (int p=0;p<rlen;) {
+			int n=(uchar)raw[p+1] | ((uchar)raw[p+2]<<8);
+			p+=3;
+			na+=n;
+			for (int k=0;k<n;k++) {
+				p+=strlen(raw+p)+1;
+				int l=strlen(raw+p)+1;
+				vlen+=l;
+				p+=l;
+			}
+		}
+		attrs->reserve(na, vlen);
+	}
+	else GffAttrs::own(attrs);
+	for (int p=0;p<rlen;) {
+		int mode=raw[p];
+		int n=(uchar)raw[p+1] | ((uchar)raw[p+2]<<8);
+		p+=3;
+		for (int k=0;k<n;k++) {
+			const char* name=raw+p;
+			p+=strlen(name)+1;
+			const char* value=raw+p;
+			p+=strlen(value)+1;
+			if (mode & 1) attrs->add_if_new(names, name, value);
+			else attrs->add_or_update(names, name, value, (mode & 2));
+		}
+	}
+	GFREE(raw);
+	if (attrs->Count()==0) GffAttrs::unref(attrs);
 }
 
 void GffObj::addAttr(const char* attrname, const char* attrvalue) {
+  getAttrs();
   if (this->attrs==NULL)
       this->attrs=new GffAttrs();
   //this->attrs->Add(new GffAttr(names->attrs.addName(attrname),attrvalue));
-  this->attrs->add_or_update(names, attrname, attrvalue);
+  GffAttrs::own(this->attrs)->add_or_update(names, attrname, attrvalue);
 }
 
 void GffObj::copyAttrs(GffObj* from) { //typically from is the parent gene, and this is a transcript
-	if (from==NULL || from->attrs==NULL || from->attrs->Count()==0) return;
-	if (this->attrs==NULL) {
-		this->attrs=new GffAttrs();
-	}
+	if (from==NULL || from->getAttrs()==NULL || from->attrs->Count()==0) return;
+	bool inherit=(this->getAttrs()==NULL);
+	if (inherit) this->attrs=new GffAttrs();
+		else GffAttrs::own(this->attrs);
 	//special RefSeq case
 	int desc_attr_id=names->attrs.getId("description"); //from gene
 	int prod_attr_id=names->attrs.getId("product"); //from transcript (this)
@@ -2450,7 +4269,12 @@ void GffObj::copyAttrs(GffObj* from) { //typically from is the parent gene, and
 			}
 		}
 		if (!haveit)
-			this->attrs->Add(new GffAttr(aid, from->attrs->Get(i)->attr_val));
+			this->attrs->Add(aid, from->attrs->Get(i)->attr_val);
+	}
+	if (inherit && this->attrs->sameAs(*from->attrs)) {
+		//nothing of its own: share the parent's list
+		GffAttrs::unref(this->attrs);
+		this->attrs=from->attrs->ref();
 	}
 }
 
@@ -2471,10 +4295,11 @@ void GffObj::setRefName(const char* newname) {
 
 
 int GffObj::removeAttr(const char* attrname, const char* attrval) {
-  if (this->attrs==NULL || attrname==NULL || attrname[0]==0) return 0;
+  if (this->getAttrs()==NULL || attrname==NULL || attrname[0]==0) return 0;
   int aid=this->names->attrs.getId(attrname);
   if (aid<0) return 0;
   int delcount=0;  //could be more than one ?
+  GffAttrs::own(this->attrs);
   for (int i=0;i<this->attrs->Count();i++) {
      if (aid==this->attrs->Get(i)->attr_id) {
        if (attrval==NULL ||
@@ -2489,8 +4314,9 @@ int GffObj::removeAttr(const char* attrname, const char* attrval) {
 }
 
 int GffObj::removeAttr(int aid, const char* attrval) {
-  if (this->attrs==NULL || aid<0) return 0;
+  if (this->getAttrs()==NULL || aid<0) return 0;
   int delcount=0;  //could be more than one ?
+  GffAttrs::own(this->attrs);
   for (int i=0;i<this->attrs->Count();i++) {
      if (aid==this->attrs->Get(i)->attr_id) {
        if (attrval==NULL ||
@@ -2510,6 +4336,7 @@ int GffObj::removeExonAttr(GffExon& exon, const char* attrname, const char* attr
   int aid=this->names->attrs.getId(attrname);
   if (aid<0) return 0;
   int delcount=0;  //could be more than one
+  GffAttrs::own(exon.attrs);
   for (int i=0;i<exon.attrs->Count();i++) {
      if (aid==exon.attrs->Get(i)->attr_id) {
        if (attrval==NULL ||
@@ -2526,6 +4353,7 @@ int GffObj::removeExonAttr(GffExon& exon, const char* attrname, const char* attr
 int GffObj::removeExonAttr(GffExon& exon, int aid, const char* attrval) {
   if (exon.attrs==NULL || aid<0) return 0;
   int delcount=0;  //could be more than one
+  GffAttrs::own(exon.attrs);
   for (int i=0;i<exon.attrs->Count();i++) {
      if (aid==exon.attrs->Get(i)->attr_id) {
        if (attrval==NULL ||
@@ -2821,9 +4649,9 @@ void GffObj::printGxfExon(FILE* fout, const char* tlabel, const char* gseqname,
         attrname=names->attrs.getName(exon->attrs->Get(i)->attr_id);
         if (cvtChars) {
           decodeHexChars(dbuf, exon->attrs->Get(i)->attr_val, dbuf_len-1);
-          fprintf(fout,";%s=%s", attrname, dbuf);
+          fprintf(fout, gff3AttrFmt(dbuf), attrname, dbuf);
         } else {
-          fprintf(fout,";%s=%s", attrname, exon->attrs->Get(i)->attr_val);
+          fprintf(fout, gff3AttrFmt(exon->attrs->Get(i)->attr_val), attrname, exon->attrs->Get(i)->attr_val);
         }
       }
     }
@@ -2933,7 +4761,7 @@ void GffObj::printGxf(FILE* fout, GffPrintMode gffp,
 	   if (gid!=NULL) fprintf(fout, "; gene_id \"%s\"",gid);
 	   if (gene_name!=NULL && getAttr("gene_name")==NULL && getAttr("GENE_NAME")==NULL)
 	      fprintf(fout, "; gene_name \"%s\"",gene_name);
-	   if (attrs!=NULL) {
+	   if (getAttrs()!=NULL) {
 		    bool trId=false;
 		    //bool gId=false;
 		    for (int i=0;i<attrs->Count();i++) {
@@ -3009,7 +4837,7 @@ void GffObj::printGxf(FILE* fout, GffPrintMode gffp,
       fprintf(fout, ";geneID=%s",geneID);
    if (gene_name!=NULL && !parentPrint && getAttr("gene_name")==NULL && getAttr("GENE_NAME")==NULL)
       fprintf(fout, ";gene_name=%s",gene_name);
-   if (attrs!=NULL) {
+   if (getAttrs()!=NULL) {
 	    for (int i=0;i<attrs->Count();i++) {
 	      const char* attrname=names->attrs.getName(attrs->Get(i)->attr_id);
 	      const char* attrval=attrs->Get(i)->attr_val;
@@ -3017,10 +4845,10 @@ void GffObj::printGxf(FILE* fout, GffPrintMode gffp,
 	    	  //fprintf(fout,";%s",attrname);
 	      if (cvtChars) {
 	    	  decodeHexChars(dbuf, attrval, DBUF_LEN-1);
-	    	  fprintf(fout,";%s=%s", attrname, dbuf);
+	    	  fprintf(fout, gff3AttrFmt(dbuf), attrname, dbuf);
 	      }
 	      else
-	    	 fprintf(fout,";%s=%s", attrname, attrs->Get(i)->attr_val);
+	    	 fprintf(fout, gff3AttrFmt(attrval), attrname, attrval);
 	    }
    }
    fprintf(fout,"\n");
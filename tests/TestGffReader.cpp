@@ -0,0 +1,272 @@
+/*
+ * TestGffReader.cpp
+ *
+ *  checks the GffReader loading paths against each other on small GTF and GFF3 files:
+ *  readAll() vs. readAll(nthreads), plain vs. gzip vs. BGZF input, readRegion() vs. a
+ *  full overlap scan, and the snapshot and GffImage round-trips (including an empty list)
+ *
+ *  usage: TestGffReader <data_dir> <work_dir>
+ */
+#include "gff.h"
+#include "GffImage.h"
+#include "GStr.h"
+#include <zlib.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+static int failures=0;
+
+#define CHECK(cond, ...) do { \
+	if (!(cond)) { failures++; GMessage("FAILED: "); GMessage(__VA_ARGS__); GMessage("\n"); } \
+} while (0)
+
+static std::string fileText(FILE* f) {
+	std::string s;
+	char buf[8192];
+	rewind(f);
+	size_t n;
+	while ((n=fread(buf, 1, sizeof(buf), f))>0) s.append(buf, n);
+	return s;
+}
+
+static bool sameStr(const char* a, const char* b) {
+	return (a==NULL || b==NULL) ? a==b : strcmp(a, b)==0;
+}
+
+static std::string recText(GffObj* gfo) {
+	FILE* f=tmpfile();
+	if (f==NULL) GError("Error: cannot create a temporary file!\n");
+	fprintf(f, "%s %s:%u-%u parent=%s\n", gfo->getID(), gfo->getGSeqName(), gfo->start, gfo->end,
+			gfo->parent!=NULL ? gfo->parent->getID() : "-");
+	gfo->printGxf(f, pgffBoth);
+	std::string s=fileText(f);
+	fclose(f);
+	return s;
+}
+
+static std::string listText(GfList& gflst) {
+	std::string s;
+	for (int i=0;i<gflst.Count();i++) s+=recText(gflst[i]);
+	return s;
+}
+
+static bool readFile(const char* fn, std::string& data) {
+	FILE* f=fopen(fn, "rb");
+	if (f==NULL) return false;
+	data=fileText(f);
+	fclose(f);
+	return true;
+}
+
+static bool writeGzip(const char* fn, const std::string& data) {
+	gzFile gz=gzopen(fn, "wb");
+	if (gz==NULL) return false;
+	bool ok=(gzwrite(gz, data.data(), data.size())==(int)data.size());
+	return (gzclose(gz)==Z_OK && ok);
+}
+
+//BGZF: gzip members of at most 64K, with their size in a "BC" extra field
+static bool putBGZFBlock(FILE* f, const char* data, uint len) {
+	uchar out[65536];
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY)!=Z_OK)
+		return false;
+	zs.next_in=(Bytef*)data;
+	zs.avail_in=len;
+	zs.next_out=out+18;
+	zs.avail_out=sizeof(out)-26;
+	int r=deflate(&zs, Z_FINISH);
+	uint clen=zs.total_out;
+	deflateEnd(&zs);
+	if (r!=Z_STREAM_END) return false;
+	uint bsize=18+clen+8;
+	static const uchar hdr[16]={0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0};
+	memcpy(out, hdr, 16);
+	out[16]=(bsize-1) & 0xff;
+	out[17]=(bsize-1)>>8;
+	uint crc=crc32(0L, (const Bytef*)data, len);
+	uchar* p=out+18+clen;
+	for (int i=0;i<4;i++) p[i]=(crc>>(8*i)) & 0xff;
+	for (int i=0;i<4;i++) p[4+i]=(len>>(8*i)) & 0xff;
+	return (fwrite(out, 1, bsize, f)==bsize);
+}
+
+static bool writeBGZF(const char* fn, const std::string& data) {
+	FILE* f=fopen(fn, "wb");
+	if (f==NULL) return false;
+	bool ok=true;
+	//small blocks, so that records and lines span block boundaries
+	for (size_t p=0;ok && p<data.size();p+=4096)
+		ok=putBGZFBlock(f, data.data()+p, GMIN(data.size()-p, (size_t)4096));
+	if (ok) ok=putBGZFBlock(f, "", 0); //EOF marker
+	return (fclose(f)==0 && ok);
+}
+
+static void testFile(const char* datadir, const char* workdir, const char* name) {
+	std::string data;
+	GStr src(datadir);
+	src.append('/').append(name);
+	if (!readFile(src.chars(), data)) {
+		CHECK(false, "cannot read %s", src.chars());
+		return;
+	}
+	GStr plain(workdir), gz(workdir), bgz(workdir);
+	plain.append('/').append(name);
+	gz.append('/').append(name).append(".gz");
+	bgz.append('/').append(name).append(".bgz");
+	FILE* f=fopen(plain.chars(), "wb");
+	CHECK(f!=NULL && fwrite(data.data(), 1, data.size(), f)==data.size() && fclose(f)==0,
+			"cannot write %s", plain.chars());
+	CHECK(writeGzip(gz.chars(), data), "cannot write %s", gz.chars());
+	CHECK(writeBGZF(bgz.chars(), data), "cannot write %s", bgz.chars());
+
+	GffReader rd(plain.chars(), false, true);
+	rd.keepAttrs(true, false, false);
+	rd.readAll();
+	std::string ref=listText(rd.gflst);
+	CHECK(rd.gflst.Count()>0, "%s: no records loaded", name);
+
+	//multi-threaded parsing
+	{
+		GffReader r(plain.chars(), false, true);
+		r.keepAttrs(true, false, false);
+		r.readAll(4);
+		CHECK(listText(r.gflst)==ref, "%s: readAll(4) differs from readAll()", name);
+	}
+	//compressed input
+	const char* zfiles[]={gz.chars(), bgz.chars()};
+	for (int z=0;z<2;z++) {
+		GffReader r(zfiles[z], false, true);
+		r.keepAttrs(true, false, false);
+		r.readAll();
+		CHECK(listText(r.gflst)==ref, "%s: readAll() differs from the plain input", zfiles[z]);
+		GffReader rt(zfiles[z], false, true);
+		rt.keepAttrs(true, false, false);
+		rt.readAll(4);
+		CHECK(listText(rt.gflst)==ref, "%s: readAll(4) differs from the plain input", zfiles[z]);
+	}
+
+	//region queries, against a scan of all the records
+	const char* ifiles[]={plain.chars(), bgz.chars()};
+	for (int z=0;z<2;z++) {
+		{
+			GffReader ix(ifiles[z], false, true);
+			ix.keepAttrs(true, false, false);
+			CHECK(ix.buildIndex()>0, "%s: buildIndex() failed", ifiles[z]);
+		}
+		GffReader rr(ifiles[z], false, true);
+		rr.keepAttrs(true, false, false);
+		int nq=0;
+		for (int i=0;i<rd.gflst.Count();i+=3) {
+			GffObj* q=rd.gflst[i];
+			uint qs[3][2]={ {q->start, q->start}, {q->start+1, q->end+5000},
+				{q->start>20000 ? q->start-20000 : 1, q->start} };
+			for (int k=0;k<3;k++) {
+				std::vector<std::string> exp, got;
+				for (int j=0;j<rd.gflst.Count();j++) {
+					GffObj* o=rd.gflst[j];
+					if (strcmp(o->getGSeqName(), q->getGSeqName())==0 && o->overlap(qs[k][0], qs[k][1]))
+						exp.push_back(recText(o));
+				}
+				rr.readRegion(q->getGSeqName(), qs[k][0], qs[k][1]);
+				for (int j=0;j<rr.gflst.Count();j++) got.push_back(recText(rr.gflst[j]));
+				std::sort(exp.begin(), exp.end());
+				std::sort(got.begin(), got.end());
+				CHECK(exp==got, "%s: readRegion(%s, %u, %u) found %d records instead of %d", ifiles[z],
+						q->getGSeqName(), qs[k][0], qs[k][1], (int)got.size(), (int)exp.size());
+				nq++;
+			}
+		}
+		CHECK(nq>0, "%s: no region queries", ifiles[z]);
+		GMessage("%s: %d records, %d region queries\n", ifiles[z], rd.gflst.Count(), nq);
+	}
+
+	//snapshot round-trip
+	GStr snap(plain);
+	snap.append(".snap");
+	CHECK(rd.saveSnapshot(snap.chars()), "%s: saveSnapshot() failed", name);
+	{
+		GffReader r(plain.chars(), false, true);
+		r.keepAttrs(true, false, false);
+		CHECK(r.loadSnapshot(snap.chars()), "%s: loadSnapshot() failed", name);
+		CHECK(listText(r.gflst)==ref, "%s: the snapshot records differ", name);
+	}
+
+	//image round-trip
+	GStr imgfn(plain);
+	imgfn.append(".gimg");
+	CHECK(GffImage::build(imgfn.chars(), rd.gflst), "%s: GffImage::build() failed", name);
+	GffImage img;
+	CHECK(img.open(imgfn.chars()), "%s: cannot open the image", name);
+	CHECK(img.Count()==rd.gflst.Count(), "%s: image has %d records instead of %d", name,
+			img.Count(), rd.gflst.Count());
+	GHash<int> recidx(true); //records by location and ID
+	for (int i=0;i<rd.gflst.Count();i++) {
+		GffObj* o=rd.gflst[i];
+		GStr k(o->getGSeqName());
+		k.append(':').append((int)o->start).append('-').append((int)o->end).append(' ').append(o->getID());
+		recidx.Add(k.chars(), new int(i));
+	}
+	for (int i=0;i<img.Count();i++) {
+		GffImageRec ir=img[i];
+		GStr k(ir.getGSeqName());
+		k.append(':').append((int)ir.start).append('-').append((int)ir.end).append(' ').append(ir.getID());
+		int* ri=recidx.Find(k.chars());
+		if (ri==NULL) {
+			CHECK(false, "%s: image record %s not found", name, k.chars());
+			continue;
+		}
+		GffObj* o=rd.gflst[*ri];
+		GVec<GSeg> ex;
+		ir.getExons(ex);
+		bool same=(ir.strand==o->strand && ir.CDstart==o->CDstart && ir.CDend==o->CDend &&
+				sameStr(ir.getGeneID(), o->getGeneID()) && sameStr(ir.getGeneName(), o->getGeneName()) &&
+				ex.Count()==o->exons.Count());
+		for (int e=0;same && e<ex.Count();e++)
+			same=(ex[e].start==o->exons[e]->start && ex[e].end==o->exons[e]->end);
+		CHECK(same, "%s: image record %s differs", name, k.chars());
+	}
+}
+
+//a file without records: the snapshot and the image of the empty list must load
+static void testEmpty(const char* workdir) {
+	GStr fn(workdir);
+	fn.append("/empty.gff3");
+	FILE* f=fopen(fn.chars(), "w");
+	if (f==NULL) {
+		CHECK(false, "cannot write %s", fn.chars());
+		return;
+	}
+	fprintf(f, "##gff-version 3\n#no records\n");
+	fclose(f);
+	GffReader rd(fn.chars(), false, true);
+	rd.readAll();
+	CHECK(rd.gflst.Count()==0, "empty.gff3: %d records loaded", rd.gflst.Count());
+	GStr snap(fn);
+	snap.append(".snap");
+	CHECK(rd.saveSnapshot(snap.chars()), "empty.gff3: saveSnapshot() failed");
+	{
+		GffReader r(fn.chars(), false, true);
+		CHECK(r.loadSnapshot(snap.chars()) && r.gflst.Count()==0, "empty.gff3: loadSnapshot() failed");
+	}
+	GStr imgfn(fn);
+	imgfn.append(".gimg");
+	CHECK(GffImage::build(imgfn.chars(), rd.gflst), "empty.gff3: GffImage::build() failed");
+	GffImage img;
+	CHECK(img.open(imgfn.chars()) && img.Count()==0, "empty.gff3: cannot open the image");
+}
+
+int main(int argc, char* argv[]) {
+	if (argc!=3) GError("Usage: TestGffReader <data_dir> <work_dir>\n");
+	const char* tests[]={"test.gtf", "test.gff3"};
+	for (int i=0;i<2;i++) testFile(argv[1], argv[2], tests[i]);
+	testEmpty(argv[2]);
+	if (failures>0) {
+		GMessage("%d check(s) failed\n", failures);
+		return 1;
+	}
+	GMessage("all checks passed\n");
+	return 0;
+}